@@ -0,0 +1,463 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * Block compressed images (IH_COMP_BLOCK). The data is cut into blocks
+ * of the same uncompressed size which are compressed one by one, so
+ * each block can be uncompressed on its own. The image data is
+ *
+ *   struct block_header
+ *   count + 1 offsets of the blocks, from the end of the offsets
+ *   the compressed blocks
+ *
+ * all numbers big endian, as in the image header.
+ *
+ * With CONFIG_MP and CONFIG_BOOTM_BLOCK_ENTRY the blocks are shared out
+ * between the cores: core n takes blocks n, n + cores, ... The secondary
+ * cores are started with cpu_release() at bootm_block_entry() and parked
+ * when they are done. A released core has no stack, so there is no C
+ * default: the arch provides bootm_block_entry() (in assembly) and sets
+ * CONFIG_BOOTM_BLOCK_ENTRY, without it the boot core uncompresses all
+ * blocks. malloc() is not SMP safe, so only the decompressors that
+ * allocate nothing (none, lzo, lz4) run on the secondary cores, gzip
+ * and lzma blocks are uncompressed by the boot core alone.
+ *
+ * The caches of the cores are not taken to be coherent: what the
+ * secondary cores read is flushed before they start, they write back
+ * each block and their job state, and the boot core invalidates both
+ * before it looks at them. A core that makes no progress for
+ * CONFIG_BOOTM_BLOCK_JOB_TIMEOUT is parked and its job done again by
+ * the boot core.
+ */
+
+#include <common.h>
+#include <watchdog.h>
+#include <image.h>
+#include "image_comp.h"
+#include <malloc.h>
+#include <asm/byteorder.h>
+
+#ifdef CONFIG_LZMA
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+#include <lzma/LzmaTools.h>
+#endif /* CONFIG_LZMA */
+
+#ifdef CONFIG_LZO
+#include <linux/lzo.h>
+#endif /* CONFIG_LZO */
+
+#ifdef CONFIG_LZ4
+extern int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
+#endif
+
+#define BLOCK_MAGIC		0x55424c4b	/* "UBLK" */
+
+#ifndef CONFIG_BOOTM_BLOCK_CORES
+#define CONFIG_BOOTM_BLOCK_CORES	4	/* at most */
+#endif
+
+#ifndef CONFIG_BOOTM_BLOCK_STACK
+#define CONFIG_BOOTM_BLOCK_STACK	0x2000	/* for a secondary core */
+#endif
+
+#ifndef CONFIG_BOOTM_BLOCK_TIMEOUT
+#define CONFIG_BOOTM_BLOCK_TIMEOUT	100	/* ms for a core to start */
+#endif
+
+#ifndef CONFIG_BOOTM_BLOCK_JOB_TIMEOUT
+#define CONFIG_BOOTM_BLOCK_JOB_TIMEOUT	1000	/* ms for a core per block */
+#endif
+
+#if defined(CONFIG_MP) && defined(CONFIG_BOOTM_BLOCK_ENTRY)
+#define BOOTM_BLOCK_MP
+#endif
+
+#ifdef CONFIG_SYS_CACHELINE_SIZE
+#define BLOCK_CACHELINE		CONFIG_SYS_CACHELINE_SIZE
+#else
+#define BLOCK_CACHELINE		64
+#endif
+
+struct block_header {
+	uint32_t magic;
+	uint8_t  comp;		/* IH_COMP_* of the blocks */
+	uint8_t  pad[3];
+	uint32_t block_size;	/* uncompressed, of all but the last block */
+	uint32_t size;		/* uncompressed, of all blocks */
+	uint32_t count;
+};
+
+struct block_image {
+	const uchar *data;	/* first block */
+	const uint32_t *offset;
+	uchar *load;
+	uint8_t comp;
+	ulong block_size;
+	ulong size;
+	ulong count;
+};
+
+#define JOB_IDLE		0
+#define JOB_RUNNING		1
+#define JOB_DONE		2
+#define JOB_ERROR		3
+
+/* one cache line each, a core writes back only its own */
+struct block_job {
+	struct block_image *img;
+	ulong first;		/* blocks first, first + step, ... */
+	ulong step;
+	ulong sp;		/* top of the stack of a secondary core */
+	int boot;		/* run by the boot core */
+	volatile int state;
+	volatile ulong done;	/* blocks done, to see it is alive */
+} __attribute__((aligned(BLOCK_CACHELINE)));
+
+/* not on the stack, the secondary cores read them from memory */
+static struct block_image block_img;
+static struct block_job block_jobs[CONFIG_BOOTM_BLOCK_CORES];
+
+/*****************************************************************************/
+
+static int block_uncompress(struct block_image *img, ulong ix)
+{
+	const uchar *src = img->data + ntohl(img->offset[ix]);
+	ulong srclen = ntohl(img->offset[ix + 1]) - ntohl(img->offset[ix]);
+	uchar *dst = img->load + ix * img->block_size;
+	ulong len = img->size - ix * img->block_size;
+
+	if (len > img->block_size)
+		len = img->block_size;
+
+	switch (img->comp) {
+	case IH_COMP_NONE:
+		if (srclen != len)
+			return -1;
+		memcpy(dst, src, len);
+		return 0;
+#ifdef CONFIG_GZIP
+	case IH_COMP_GZIP: {
+		unsigned long unc_len = srclen;
+
+		if (gunzip(dst, len, (uchar *)src, &unc_len) || unc_len != len)
+			return -1;
+		return 0;
+	}
+#endif /* CONFIG_GZIP */
+#ifdef CONFIG_LZMA
+	case IH_COMP_LZMA: {
+		SizeT unc_len = len;
+
+		if (lzmaBuffToBuffDecompress(dst, &unc_len, (uchar *)src,
+					     srclen) != SZ_OK
+		    || unc_len != len)
+			return -1;
+		return 0;
+	}
+#endif /* CONFIG_LZMA */
+#ifdef CONFIG_LZO
+	case IH_COMP_LZO: {
+		size_t unc_len = len;
+
+		if (lzo1x_decompress_safe(src, srclen, dst, &unc_len)
+				!= LZO_E_OK
+		    || unc_len != len)
+			return -1;
+		return 0;
+	}
+#endif /* CONFIG_LZO */
+#ifdef CONFIG_LZ4
+	case IH_COMP_LZ4: {
+		size_t unc_len = len;
+
+		if (ulz4fn(src, srclen, dst, &unc_len) || unc_len != len)
+			return -1;
+		return 0;
+	}
+#endif /* CONFIG_LZ4 */
+	}
+	return -1;
+}
+
+static void block_range(struct block_image *img, ulong ix, ulong *start,
+			ulong *end)
+{
+	*start = (ulong)img->load + ix * img->block_size;
+	*end = (ix == img->count - 1) ? (ulong)img->load + img->size
+		: *start + img->block_size;
+}
+
+static void block_set_state(struct block_job *job, int state)
+{
+	job->state = state;
+	if (!job->boot)
+		flush_dcache_range((ulong)job, (ulong)(job + 1));
+}
+
+/* runs on any core */
+static void block_run(struct block_job *job)
+{
+	struct block_image *img = job->img;
+	ulong ix, start, end;
+
+	block_set_state(job, JOB_RUNNING);
+	for (ix = job->first; ix < img->count; ix += job->step) {
+		if (job->boot)
+			WATCHDOG_RESET();
+		if (block_uncompress(img, ix)) {
+			block_set_state(job, JOB_ERROR);
+			return;
+		}
+		/* the output to memory before the boot core is told */
+		if (!job->boot) {
+			block_range(img, ix, &start, &end);
+			flush_dcache_range(start, end);
+		}
+		job->done++;
+	}
+	block_set_state(job, JOB_DONE);
+}
+/*****************************************************************************/
+#ifdef BOOTM_BLOCK_MP
+/*
+ * A released core enters bootm_block_entry() of the arch with the job
+ * as argument, which sets sp to job->sp and calls bootm_block_run().
+ */
+extern void bootm_block_entry(struct block_job *job);
+
+void bootm_block_run(struct block_job *job)
+{
+	block_run(job);
+	for (;;)
+		;	/* until bootm_block_park() */
+}
+
+/* the arguments of cpu_release() are those of the ppc spin table */
+int __bootm_block_release(int cpu, ulong entry, ulong arg)
+{
+	char addr[20], r3[20];
+	char *argv[4] = { addr, "-", r3, "-" };
+
+	sprintf(addr, "%lx", entry);
+	sprintf(r3, "%lx", arg);
+	return cpu_release(cpu, 4, argv);
+}
+int bootm_block_release(int cpu, ulong entry, ulong arg)
+	__attribute__((weak, alias("__bootm_block_release")));
+
+void __bootm_block_park(int cpu)
+{
+	cpu_reset(cpu);
+}
+void bootm_block_park(int cpu)
+	__attribute__((weak, alias("__bootm_block_park")));
+
+static int block_cores(struct block_image *img)
+{
+	int cores;
+
+	/* malloc() in the decompressor, boot core only */
+	if (img->comp != IH_COMP_NONE && img->comp != IH_COMP_LZO
+	    && img->comp != IH_COMP_LZ4)
+		return 1;
+
+	/* blocks sharing a cache line would be written back over each other */
+	if (img->block_size % BLOCK_CACHELINE
+	    || (ulong)img->load % BLOCK_CACHELINE)
+		return 1;
+
+	cores = cpu_numcores();
+	if (cores > CONFIG_BOOTM_BLOCK_CORES)
+		cores = CONFIG_BOOTM_BLOCK_CORES;
+	if (cores > img->count)
+		cores = img->count;
+	return cores < 1 ? 1 : cores;
+}
+
+/* the job of a secondary core as it is in memory */
+static void block_job_sync(struct block_job *job)
+{
+	invalidate_dcache_range((ulong)job, (ulong)(job + 1));
+}
+
+/*
+ * Wait for the job of a secondary core, park the core. Returns 0 if it
+ * did the job, -1 if the boot core has to do it.
+ */
+static int block_wait(struct block_job *job, int cpu)
+{
+	ulong start, done;
+
+	start = get_timer(0);
+	block_job_sync(job);
+	while (job->state == JOB_IDLE
+	       && get_timer(start) < CONFIG_BOOTM_BLOCK_TIMEOUT) {
+		WATCHDOG_RESET();
+		block_job_sync(job);
+	}
+
+	/* as long as it gets blocks done */
+	start = get_timer(0);
+	done = job->done;
+	while (job->state == JOB_RUNNING) {
+		WATCHDOG_RESET();
+		if (job->done != done) {
+			done = job->done;
+			start = get_timer(0);
+		} else if (get_timer(start) >= CONFIG_BOOTM_BLOCK_JOB_TIMEOUT) {
+			printf("BLOCK: core %d stuck, taking its blocks ", cpu);
+			break;
+		}
+		block_job_sync(job);
+	}
+	bootm_block_park(cpu);
+
+	if (job->state != JOB_DONE && job->state != JOB_ERROR)
+		return -1;
+	return 0;
+}
+
+/* the blocks a secondary core wrote, as they are in memory */
+static void block_job_output(struct block_job *job)
+{
+	struct block_image *img = job->img;
+	ulong ix, start, end;
+
+	for (ix = job->first; ix < img->count; ix += job->step) {
+		block_range(img, ix, &start, &end);
+		invalidate_dcache_range(start, end);
+	}
+}
+#endif /* BOOTM_BLOCK_MP */
+/*****************************************************************************/
+
+static int block_open(struct block_image *img, void *load,
+		      const void *src, ulong srclen, ulong unc_len)
+{
+	const struct block_header *hdr = src;
+	ulong ix, offset, next, end;
+
+	if (srclen < sizeof(*hdr) || ntohl(hdr->magic) != BLOCK_MAGIC) {
+		puts ("BLOCK: bad magic ");
+		return -1;
+	}
+
+	img->comp = hdr->comp;
+	img->block_size = ntohl(hdr->block_size);
+	img->size = ntohl(hdr->size);
+	img->count = ntohl(hdr->count);
+	img->offset = (const uint32_t *)(hdr + 1);
+	img->data = (const uchar *)(img->offset + img->count + 1);
+	img->load = load;
+
+	if (!img->block_size || img->size > unc_len
+	    || img->count != (img->size + img->block_size - 1)
+			/ img->block_size
+	    || img->count >= srclen / sizeof(uint32_t)
+	    || img->data > (const uchar *)src + srclen) {
+		puts ("BLOCK: bad header ");
+		return -1;
+	}
+
+	end = (const uchar *)src + srclen - img->data;
+	for (ix = 0, offset = 0; ix <= img->count; ix++, offset = next) {
+		next = ntohl(img->offset[ix]);
+		if (next < offset || next > end) {
+			puts ("BLOCK: bad index ");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Uncompress a block compressed image of "srclen" bytes at "src" to
+ * "load". "unc_len" is the room at "load" and returns the uncompressed
+ * size.
+ */
+int bootm_block_uncompress(void *load, ulong *unc_len,
+			   const void *src, ulong srclen)
+{
+	struct block_image *img = &block_img;
+	struct block_job *job = block_jobs;
+	int cores = 1;
+	int ret = 0;
+	int cpu;
+#ifdef BOOTM_BLOCK_MP
+	uchar *stack[CONFIG_BOOTM_BLOCK_CORES];
+#endif
+
+	if (block_open(img, load, src, srclen, *unc_len))
+		return -1;
+
+#ifdef BOOTM_BLOCK_MP
+	cores = block_cores(img);
+#endif
+	for (cpu = 0; cpu < cores; cpu++) {
+		job[cpu].img = img;
+		job[cpu].first = cpu;
+		job[cpu].step = cores;
+		job[cpu].sp = 0;
+		job[cpu].boot = !cpu;
+		job[cpu].state = JOB_IDLE;
+		job[cpu].done = 0;
+	}
+
+#ifdef BOOTM_BLOCK_MP
+	if (cores > 1) {
+		/* nothing dirty of ours may be written back over their work */
+		flush_dcache_range((ulong)src, (ulong)src + srclen);
+		flush_dcache_range((ulong)load, (ulong)load + img->size);
+		flush_dcache_range((ulong)img, (ulong)(img + 1));
+	}
+	for (cpu = 1; cpu < cores; cpu++) {
+		stack[cpu] = malloc(CONFIG_BOOTM_BLOCK_STACK);
+		if (!stack[cpu])
+			continue;
+		job[cpu].sp = ((ulong)stack[cpu] + CONFIG_BOOTM_BLOCK_STACK)
+			& ~15UL;
+		flush_dcache_range((ulong)stack[cpu],
+			(ulong)stack[cpu] + CONFIG_BOOTM_BLOCK_STACK);
+		flush_dcache_range((ulong)&job[cpu], (ulong)&job[cpu + 1]);
+		if (bootm_block_release(cpu, (ulong)bootm_block_entry,
+					(ulong)&job[cpu]))
+			job[cpu].sp = 0;	/* the boot core does it */
+	}
+#endif
+
+	block_run(&job[0]);
+	if (job[0].state != JOB_DONE)
+		ret = -1;
+
+	for (cpu = 1; cpu < cores; cpu++) {
+#ifdef BOOTM_BLOCK_MP
+		if (job[cpu].sp) {
+			if (block_wait(&job[cpu], cpu))
+				job[cpu].state = JOB_IDLE;
+			else if (job[cpu].state == JOB_DONE)
+				block_job_output(&job[cpu]);
+		}
+		if (stack[cpu])
+			free(stack[cpu]);
+#endif
+		/* not released, it did not come up or got stuck */
+		if (job[cpu].state == JOB_IDLE) {
+			job[cpu].boot = 1;
+			job[cpu].done = 0;
+			block_run(&job[cpu]);
+		}
+		if (job[cpu].state != JOB_DONE)
+			ret = -1;
+	}
+
+	debug ("BLOCK: %lu blocks of %lu bytes on %d cores\n",
+		img->count, img->block_size, cores);
+	if (ret)
+		return ret;
+	*unc_len = img->size;
+	return 0;
+}
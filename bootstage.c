@@ -0,0 +1,269 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * Boot stage timing. Code marks the end of a boot phase with
+ * bootstage_mark("name"), show_boot_progress() marks its ids. The marks
+ * go into a fixed table, nothing is allocated, so it can be used from
+ * early board code on. The "bootstage" command prints the table with the
+ * time spent since the previous mark, the marks are handed to Linux in
+ * the device tree (/bootstage) and, with CONFIG_BOOTSTAGE_STASH, as a
+ * table at a fixed address for kernels booted with ATAGs.
+ *
+ * Times are in microseconds since the timer started counting, boards
+ * with a better clock can provide their own timer_get_boot_us().
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc.h>
+#include <div64.h>
+#include "bootstage.h"
+#ifdef CONFIG_OF_LIBFDT
+#include <libfdt.h>
+#endif
+
+#ifndef CONFIG_BOOTSTAGE_RECORD_COUNT
+#define CONFIG_BOOTSTAGE_RECORD_COUNT	50
+#endif
+
+struct bootstage_record {
+	const char *name;	/* NULL for a show_boot_progress() id */
+	int id;
+	ulong time;		/* us */
+};
+
+static struct bootstage_record record[CONFIG_BOOTSTAGE_RECORD_COUNT];
+static int record_count;
+static int record_lost;		/* marks that did not fit */
+
+/*****************************************************************************/
+
+ulong __timer_get_boot_us(void)
+{
+	unsigned long long ticks = get_ticks();
+
+	ticks *= 1000000;
+	do_div(ticks, get_tbclk());
+	return (ulong)ticks;
+}
+ulong timer_get_boot_us(void)
+	__attribute__((weak, alias("__timer_get_boot_us")));
+
+static ulong bootstage_add(const char *name, int id)
+{
+	ulong time = timer_get_boot_us();
+
+	if (record_count < CONFIG_BOOTSTAGE_RECORD_COUNT) {
+		record[record_count].name = name;
+		record[record_count].id   = id;
+		record[record_count].time = time;
+		record_count++;
+	} else {
+		record_lost++;
+	}
+	return time;
+}
+
+/* "name" must stay valid, a string constant */
+ulong bootstage_mark(const char *name)
+{
+	return bootstage_add(name, 0);
+}
+
+ulong bootstage_progress(int id)
+{
+	return bootstage_add(NULL, id);
+}
+
+static const char *bootstage_name(struct bootstage_record *rec, char *buf)
+{
+	if (rec->name)
+		return rec->name;
+	sprintf(buf, "progress_%d", rec->id);
+	return buf;
+}
+/*****************************************************************************/
+
+void bootstage_report(void)
+{
+	struct bootstage_record *rec;
+	char buf[20];
+	ulong prev = 0;
+
+	printf("Timer summary in microseconds:\n");
+	printf("%11s%11s  %s\n", "Mark", "Elapsed", "Stage");
+	for (rec = record; rec < record + record_count; rec++) {
+		printf("%11lu%11lu  %s\n", rec->time, rec->time - prev,
+			bootstage_name(rec, buf));
+		prev = rec->time;
+	}
+	if (record_lost)
+		printf("%d marks lost, CONFIG_BOOTSTAGE_RECORD_COUNT is %d\n",
+			record_lost, CONFIG_BOOTSTAGE_RECORD_COUNT);
+}
+/*****************************************************************************/
+/*
+ * "bootstage" env variable: "name:us name:us ...", for scripts that
+ * want to pass the marks on, e.g. in bootargs.
+ */
+int bootstage_setenv(void)
+{
+	struct bootstage_record *rec;
+	char buf[20];
+	char *env, *s;
+	int len = 1;
+	int ret;
+
+	for (rec = record; rec < record + record_count; rec++)
+		len += strlen(bootstage_name(rec, buf)) + 12;
+	env = malloc(len);
+	if (!env)
+		return -1;
+
+	s = env;
+	*s = '\0';
+	for (rec = record; rec < record + record_count; rec++) {
+		s += sprintf(s, "%s%s:%lu", (s == env) ? "" : " ",
+			bootstage_name(rec, buf), rec->time);
+	}
+	ret = setenv("bootstage", env);
+	free(env);
+	return ret;
+}
+/*****************************************************************************/
+#ifdef CONFIG_OF_LIBFDT
+/*
+ * Add the marks to the device tree as
+ *   /bootstage/<n> { name = "..."; mark = <us>; };
+ */
+int bootstage_fdt_add(void *blob)
+{
+	struct bootstage_record *rec;
+	char buf[20];
+	int bootstage, node;
+	int ix;
+
+	bootstage = fdt_path_offset(blob, "/bootstage");
+	if (bootstage < 0)
+		bootstage = fdt_add_subnode(blob, 0, "bootstage");
+	if (bootstage < 0)
+		goto error;
+
+	for (ix = 0, rec = record; rec < record + record_count; ix++, rec++) {
+		sprintf(buf, "%d", ix);
+		node = fdt_add_subnode(blob, bootstage, buf);
+		if (node < 0)
+			goto error;
+		if (fdt_setprop_string(blob, node, "name",
+				bootstage_name(rec, buf)) < 0)
+			goto error;
+		if (fdt_setprop_cell(blob, node, "mark", rec->time) < 0)
+			goto error;
+	}
+	return 0;
+
+error:
+	printf("bootstage: cannot add marks to device tree\n");
+	return -1;
+}
+#endif /* CONFIG_OF_LIBFDT */
+/*****************************************************************************/
+#ifdef CONFIG_BOOTSTAGE_STASH
+/*
+ * Table at CONFIG_BOOTSTAGE_STASH for the kernel:
+ *   struct bootstage_stash, then "count" struct bootstage_stash_record.
+ */
+#ifndef CONFIG_BOOTSTAGE_STASH_SIZE
+#define CONFIG_BOOTSTAGE_STASH_SIZE	4096
+#endif
+
+#define BOOTSTAGE_MAGIC		0xb00757a3
+#define BOOTSTAGE_VERSION	1
+
+struct bootstage_stash {
+	u32 magic;
+	u32 version;
+	u32 count;
+	u32 size;		/* of a record */
+};
+
+struct bootstage_stash_record {
+	u32 time;
+	s32 id;
+	char name[24];
+};
+
+int bootstage_stash(void)
+{
+	struct bootstage_stash *hdr =
+		(struct bootstage_stash *)CONFIG_BOOTSTAGE_STASH;
+	struct bootstage_stash_record *out =
+		(struct bootstage_stash_record *)(hdr + 1);
+	struct bootstage_record *rec;
+	char buf[20];
+	int count = record_count;
+
+	if (sizeof(*hdr) + count * sizeof(*out) > CONFIG_BOOTSTAGE_STASH_SIZE)
+		count = (CONFIG_BOOTSTAGE_STASH_SIZE - sizeof(*hdr))
+			/ sizeof(*out);
+
+	for (rec = record; rec < record + count; rec++, out++) {
+		out->time = rec->time;
+		out->id   = rec->id;
+		strncpy(out->name, bootstage_name(rec, buf),
+			sizeof(out->name) - 1);
+		out->name[sizeof(out->name) - 1] = '\0';
+	}
+	hdr->magic   = BOOTSTAGE_MAGIC;
+	hdr->version = BOOTSTAGE_VERSION;
+	hdr->count   = count;
+	hdr->size    = sizeof(*out);
+	return count < record_count ? -1 : 0;
+}
+#endif /* CONFIG_BOOTSTAGE_STASH */
+/*****************************************************************************/
+
+int do_bootstage(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	if (argc < 2 || !strcmp(argv[1], "report")) {
+		bootstage_report();
+		return 0;
+	}
+	if (!strcmp(argv[1], "env"))
+		return bootstage_setenv() ? 1 : 0;
+#ifdef CONFIG_BOOTSTAGE_STASH
+	if (!strcmp(argv[1], "stash"))
+		return bootstage_stash() ? 1 : 0;
+#endif
+	if (!strcmp(argv[1], "mark") && argc > 2) {
+		/* the name has to outlive the command line */
+		char *name = strdup(argv[2]);
+
+		if (!name)
+			return 1;
+		bootstage_mark(name);
+		return 0;
+	}
+
+	cmd_usage(cmdtp);
+	return 1;
+}
+
+U_BOOT_CMD(
+	bootstage, 3, 0, do_bootstage,
+	"boot stage timing",
+	"[report]\n"
+	"    - print the marks and the time between them\n"
+	"bootstage env\n"
+	"    - put the marks into the 'bootstage' variable\n"
+#ifdef CONFIG_BOOTSTAGE_STASH
+	"bootstage stash\n"
+	"    - copy the marks to the table for the kernel\n"
+#endif
+	"bootstage mark name\n"
+	"    - add a mark, e.g. from bootcmd"
+);
@@ -0,0 +1,33 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * Boot stage timing of bootstage.c. Without CONFIG_BOOTSTAGE the marks
+ * compile to nothing.
+ */
+
+#ifndef __BOOTSTAGE_H__
+#define __BOOTSTAGE_H__
+
+#ifdef CONFIG_BOOTSTAGE
+extern ulong bootstage_mark(const char *name);
+extern ulong bootstage_progress(int id);
+extern void bootstage_report(void);
+extern int bootstage_setenv(void);
+extern int bootstage_fdt_add(void *blob);
+#else
+#define bootstage_mark(name)		do { } while (0)
+#define bootstage_progress(id)		do { } while (0)
+#define bootstage_fdt_add(blob)		do { } while (0)
+#endif
+
+#if defined(CONFIG_BOOTSTAGE) && defined(CONFIG_BOOTSTAGE_STASH)
+extern int bootstage_stash(void);
+#else
+#define bootstage_stash()		do { } while (0)
+#endif
+
+#endif /* __BOOTSTAGE_H__ */
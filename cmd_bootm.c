@@ -29,6 +29,8 @@
 #include <watchdog.h>
 #include <command.h>
 #include <image.h>
+#include "image_comp.h"
+#include "bootstage.h"
 #include <malloc.h>
 #include <u-boot/zlib.h>
 #include <bzlib.h>
@@ -61,6 +63,18 @@
 #include <linux/lzo.h>
 #endif /* CONFIG_LZO */
 
+#ifdef CONFIG_BOOTM_STREAM
+#ifdef CONFIG_CMD_NAND
+#include <nand_logif.h>
+#endif
+#ifdef CONFIG_CMD_MMC
+#include <emmc_logif.h>
+#endif
+#ifdef CONFIG_CMD_SF
+#include <spiflash_logif.h>
+#endif
+#endif /* CONFIG_BOOTM_STREAM */
+
 DECLARE_GLOBAL_DATA_PTR;
 
 #ifndef CONFIG_SYS_BOOTM_LEN
@@ -71,6 +85,28 @@ DECLARE_GLOBAL_DATA_PTR;
 extern void bz_internal_error(int);
 #endif
 
+#ifdef CONFIG_LZ4
+extern int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
+#endif
+
+#ifdef CONFIG_BOOTM_BLOCK
+extern int bootm_block_uncompress(void *load, ulong *unc_len,
+				  const void *src, ulong srclen);
+#endif
+
+#if defined(CONFIG_BOOTM_STREAM) && defined(CONFIG_GZIP)
+extern void *zalloc(void *, unsigned, unsigned);
+extern void zfree(void *, void *, unsigned);
+#endif
+
+#if defined(CONFIG_BOOTM_STREAM) && defined(CONFIG_CRC32_SLICE8)
+extern uint32_t crc32_slice8(uint32_t, const unsigned char *, unsigned int);
+#define bootm_stream_crc32	crc32_slice8
+#else
+#define bootm_stream_crc32	crc32
+#endif
+
+
 #if defined(CONFIG_CMD_IMI)
 static int image_info (unsigned long addr);
 #endif
@@ -325,21 +361,14 @@ static int bootm_start(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 #define BOOTM_ERR_OVERLAP	-2
 #define BOOTM_ERR_UNIMPLEMENTED	-3
 #define BOOTM_STACK_GUARD	(32 * 1024)
-static int bootm_load_os(image_info_t os, ulong *load_end, int boot_progress)
+
+/*
+ * Check whether kernel zImage overwrite uboot,
+ * which will lead to kernel boot fail.
+ */
+static int bootm_check_overwrite(ulong load, ulong image_len)
 {
-	uint8_t comp = os.comp;
-	ulong load = os.load;
-	ulong blob_start = os.start;
-	ulong blob_end = os.end;
-	ulong image_start = os.image_start;
-	ulong image_len = os.image_len;
-#if defined(CONFIG_GZIP) || defined(CONFIG_BZIP2) \
-	|| defined(CONFIG_LZMA) || defined(CONFIG_LZO)
-	uint unc_len = CONFIG_SYS_BOOTM_LEN;
-#endif
 	ulong image_end;
-
-	const char *type_name = genimg_get_type_name (os.type);
 	int boot_sp;
 
 	__asm__ __volatile__(
@@ -349,8 +378,6 @@ static int bootm_load_os(image_info_t os, ulong *load_end, int boot_progress)
 		:"cc"
 		);
 
-	/* Check whether kernel zImage overwrite uboot,
-	 * which will lead to kernel boot fail. */
 	image_end = load + image_len;
 	/* leave at most 32KByte for move image stack */
 	boot_sp -= BOOTM_STACK_GUARD;
@@ -358,6 +385,26 @@ static int bootm_load_os(image_info_t os, ulong *load_end, int boot_progress)
 		printf("\nkernel image will overwrite uboot! kernel boot fail!\n");
 		return BOOTM_ERR_RESET;
 	}
+	return 0;
+}
+
+static int bootm_load_os(image_info_t os, ulong *load_end, int boot_progress)
+{
+	uint8_t comp = os.comp;
+	ulong load = os.load;
+	ulong blob_start = os.start;
+	ulong blob_end = os.end;
+	ulong image_start = os.image_start;
+	ulong image_len = os.image_len;
+#if defined(CONFIG_GZIP) || defined(CONFIG_BZIP2) \
+	|| defined(CONFIG_LZMA) || defined(CONFIG_LZO)
+	uint unc_len = CONFIG_SYS_BOOTM_LEN;
+#endif
+
+	const char *type_name = genimg_get_type_name (os.type);
+
+	if (bootm_check_overwrite(load, image_len))
+		return BOOTM_ERR_RESET;
 
 	switch (comp) {
 	case IH_COMP_NONE:
@@ -442,6 +489,42 @@ static int bootm_load_os(image_info_t os, ulong *load_end, int boot_progress)
 		*load_end = load + unc_len;
 		break;
 #endif /* CONFIG_LZO */
+#ifdef CONFIG_LZ4
+	case IH_COMP_LZ4: {
+		size_t lz4_len = CONFIG_SYS_BOOTM_LEN;
+
+		printf ("   Uncompressing %s ... ", type_name);
+		if (ulz4fn ((void *)image_start, image_len,
+					(void *)load, &lz4_len) != 0) {
+			puts ("LZ4: uncompress or overwrite error "
+				"- must RESET board to recover\n");
+			if (boot_progress)
+				show_boot_progress (-6);
+			return BOOTM_ERR_RESET;
+		}
+
+		*load_end = load + lz4_len;
+		break;
+	}
+#endif /* CONFIG_LZ4 */
+#ifdef CONFIG_BOOTM_BLOCK
+	case IH_COMP_BLOCK: {
+		ulong block_len = CONFIG_SYS_BOOTM_LEN;
+
+		printf ("   Uncompressing %s ... ", type_name);
+		if (bootm_block_uncompress ((void *)load, &block_len,
+					(void *)image_start, image_len) != 0) {
+			puts ("BLOCK: uncompress or overwrite error "
+				"- must RESET board to recover\n");
+			if (boot_progress)
+				show_boot_progress (-6);
+			return BOOTM_ERR_RESET;
+		}
+
+		*load_end = load + block_len;
+		break;
+	}
+#endif /* CONFIG_BOOTM_BLOCK */
 	default:
 		printf ("Unimplemented compression type %d\n", comp);
 		return BOOTM_ERR_UNIMPLEMENTED;
@@ -539,6 +622,7 @@ int do_bootm_subcommand (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 			ret = bootm_load_os(images.os, &load_end, 0);
 			if (ret)
 				return ret;
+			bootstage_mark("bootm_load_os");
 
 			lmb_reserve(&images.lmb, images.os.load,
 					(load_end - images.os.load));
@@ -586,6 +670,8 @@ int do_bootm_subcommand (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 				printf ("prep subcommand not supported\n");
 			break;
 		case BOOTM_STATE_OS_GO:
+			bootstage_mark("start_kernel");
+			bootstage_stash();
 			disable_interrupts();
 			arch_preboot_os();
 			boot_fn(BOOTM_STATE_OS_GO, argc, argv, &images);
@@ -595,20 +681,12 @@ int do_bootm_subcommand (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 	return ret;
 }
 
-/*******************************************************************/
-/* bootm - boot application image from image in memory */
-/*******************************************************************/
-
-int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+/* relocate boot function table */
+static void bootm_reloc_boot_os(void)
 {
-	ulong		iflag;
-	ulong		load_end = 0;
-	int		ret;
-	boot_os_fn	*boot_fn;
 #ifndef CONFIG_RELOC_FIXUP_WORKS
 	static int relocated = 0;
 
-	/* relocate boot function table */
 	if (!relocated) {
 		int i;
 		for (i = 0; i < ARRAY_SIZE(boot_os); i++)
@@ -617,6 +695,20 @@ int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 		relocated = 1;
 	}
 #endif
+}
+
+/*******************************************************************/
+/* bootm - boot application image from image in memory */
+/*******************************************************************/
+
+int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	ulong		iflag;
+	ulong		load_end = 0;
+	int		ret;
+	boot_os_fn	*boot_fn;
+
+	bootm_reloc_boot_os();
 
 	/* determine if we have a sub command */
 	if (argc > 1) {
@@ -637,6 +729,7 @@ int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 
 	if (bootm_start(cmdtp, flag, argc, argv))
 		return 1;
+	bootstage_mark("bootm_start");
 
 	/*
 	 * We have reached the point of no return: we are going to
@@ -668,6 +761,7 @@ int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 #endif
 
 	ret = bootm_load_os(images.os, &load_end, 1);
+	bootstage_mark("bootm_load_os");
 
 	if (ret < 0) {
 		if (ret == BOOTM_ERR_RESET)
@@ -720,6 +814,8 @@ int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 		return 1;
 	}
 
+	bootstage_mark("start_kernel");
+	bootstage_stash();
 	arch_preboot_os();
 
 	boot_fn(0, argc, argv, &images);
@@ -1040,6 +1136,587 @@ U_BOOT_CMD(
 	"\tgo      - start OS"
 );
 
+#ifdef CONFIG_BOOTM_STREAM
+/*******************************************************************/
+/* bootms - boot a kernel streamed from flash */
+/*******************************************************************/
+/*
+ * The legacy kernel image is read from flash chunk by chunk and each
+ * chunk goes to the decompressor right away (or to the load address
+ * for an uncompressed kernel), so uncompressing starts with the first
+ * chunk instead of after the whole image is read, and the compressed
+ * image never sits in RAM as a whole. Its CRC is checked on the way,
+ * before the kernel is started. Compressions that cannot be fed in
+ * pieces are read to "loadaddr" in full and handed to bootm.
+ */
+#ifndef CONFIG_BOOTM_STREAM_CHUNK
+#define CONFIG_BOOTM_STREAM_CHUNK	0x20000
+#endif
+
+struct bootm_stream {
+	int (*read)(void *handle, unsigned long long offset,
+		    unsigned int length, unsigned char *buf);
+	void *handle;
+	unsigned int align;		/* read size granularity */
+	unsigned long long offset;	/* next flash offset */
+	ulong data_left;		/* image data not read yet */
+	uint32_t dcrc;
+	int verify;
+	unsigned char *buf;		/* one chunk */
+	unsigned int pos;		/* next unused byte in buf */
+	unsigned int len;		/* image data in buf */
+	ulong read_ms;
+	ulong unc_ms;
+};
+
+/* read "length" bytes of image data to "dst", it is rounded up to align */
+static int bootm_stream_read(struct bootm_stream *bs, unsigned char *dst,
+			     unsigned int length)
+{
+	unsigned int size = (length + bs->align - 1) & ~(bs->align - 1);
+	ulong start = get_timer(0);
+
+	if (bs->read(bs->handle, bs->offset, size, dst)) {
+		printf ("Read error at flash offset 0x%08llx\n", bs->offset);
+		return -1;
+	}
+	bs->read_ms += get_timer(start);
+	bs->offset += size;
+	bs->data_left -= length;
+	if (bs->verify)
+		bs->dcrc = bootm_stream_crc32(bs->dcrc, dst, length);
+	WATCHDOG_RESET();
+	return 0;
+}
+
+/* next chunk into buf, returns the bytes available or 0 at the end */
+static int bootm_stream_fill(struct bootm_stream *bs)
+{
+	unsigned int length = CONFIG_BOOTM_STREAM_CHUNK;
+
+	if (length > bs->data_left)
+		length = bs->data_left;
+	bs->pos = 0;
+	bs->len = 0;
+	if (!length || bootm_stream_read(bs, bs->buf, length))
+		return 0;
+	bs->len = length;
+	return length;
+}
+
+/* read what is left of the image, for its CRC */
+static int bootm_stream_drain(struct bootm_stream *bs)
+{
+	while (bs->data_left) {
+		if (!bootm_stream_fill(bs))
+			return -1;
+	}
+	return 0;
+}
+
+static int bootm_stream_none(struct bootm_stream *bs, uchar *load,
+			     ulong *unc_len)
+{
+	uchar *dst = load;
+	unsigned int length;
+
+	length = bs->len - bs->pos;
+	memmove (dst, bs->buf + bs->pos, length);
+	dst += length;
+
+	/* whole read units go straight to the load address */
+	while (bs->data_left >= bs->align) {
+		length = CONFIG_BOOTM_STREAM_CHUNK;
+		if (length > bs->data_left)
+			length = bs->data_left & ~(bs->align - 1);
+		if (bootm_stream_read(bs, dst, length))
+			return -1;
+		dst += length;
+	}
+	if (bs->data_left) {
+		length = bootm_stream_fill(bs);
+		if (!length)
+			return -1;
+		memcpy (dst, bs->buf, length);
+		dst += length;
+	}
+	*unc_len = dst - load;
+	return 0;
+}
+
+#ifdef CONFIG_GZIP
+#define GZ_HEAD_CRC	2
+#define GZ_EXTRA_FIELD	4
+#define GZ_ORIG_NAME	8
+#define GZ_COMMENT	0x10
+#define GZ_RESERVED	0xe0
+
+static int bootm_stream_gzip(struct bootm_stream *bs, uchar *load,
+			     ulong *unc_len)
+{
+	unsigned char *src = bs->buf + bs->pos;
+	unsigned int n = bs->len - bs->pos;
+	unsigned int i = 10;
+	z_stream s;
+	ulong start;
+	int flags, r;
+
+	/* the gzip header has to be in the first chunk */
+	if (n < i || src[2] != Z_DEFLATED
+	    || ((flags = src[3]) & GZ_RESERVED)) {
+		puts ("Error: Bad gzipped data\n");
+		return -1;
+	}
+	if (flags & GZ_EXTRA_FIELD)
+		i = 12 + src[10] + (src[11] << 8);
+	if (flags & GZ_ORIG_NAME)
+		while (i < n && src[i++] != 0)
+			;
+	if (flags & GZ_COMMENT)
+		while (i < n && src[i++] != 0)
+			;
+	if (flags & GZ_HEAD_CRC)
+		i += 2;
+	if (i >= n) {
+		puts ("Error: gunzip out of data in header\n");
+		return -1;
+	}
+
+	s.zalloc = zalloc;
+	s.zfree = zfree;
+	s.outcb = Z_NULL;
+	if (inflateInit2(&s, -MAX_WBITS) != Z_OK) {
+		puts ("Error: inflateInit2() returned error\n");
+		return -1;
+	}
+	s.next_in = src + i;
+	s.avail_in = n - i;
+	s.next_out = load;
+	s.avail_out = *unc_len;
+
+	for (;;) {
+		if (s.avail_in == 0) {
+			if (!bootm_stream_fill(bs)) {
+				puts ("Error: gunzip out of data\n");
+				r = Z_DATA_ERROR;
+				break;
+			}
+			s.next_in = bs->buf;
+			s.avail_in = bs->len;
+		}
+		start = get_timer(0);
+		r = inflate(&s, Z_NO_FLUSH);
+		bs->unc_ms += get_timer(start);
+		if (r != Z_OK)
+			break;
+	}
+	*unc_len = s.next_out - load;
+	inflateEnd(&s);
+
+	if (r != Z_STREAM_END) {
+		printf ("Error: inflate() returned %d\n", r);
+		return -1;
+	}
+	return 0;
+}
+#endif /* CONFIG_GZIP */
+
+#ifdef CONFIG_LZMA
+static void *bootm_stream_lzma_alloc(void *p, size_t size)
+{
+	return malloc(size);
+}
+
+static void bootm_stream_lzma_free(void *p, void *address)
+{
+	free(address);
+}
+
+static ISzAlloc bootm_stream_lzma = {
+	bootm_stream_lzma_alloc, bootm_stream_lzma_free
+};
+
+static int bootm_stream_lzma_dec(struct bootm_stream *bs, uchar *load,
+				 ulong *unc_len)
+{
+	unsigned char *src = bs->buf + bs->pos;
+	unsigned int n = bs->len - bs->pos;
+	unsigned long long size = 0;
+	ELzmaStatus status;
+	CLzmaDec state;
+	SizeT srclen;
+	ulong start;
+	int i, r;
+
+	/* properties and the uncompressed size, as lzmaBuffToBuffDecompress */
+	if (n < LZMA_PROPS_SIZE + 8) {
+		puts ("LZMA: header too short\n");
+		return -1;
+	}
+	for (i = 7; i >= 0; i--)
+		size = (size << 8) + src[LZMA_PROPS_SIZE + i];
+	/* 0xffffffffffffffff: size unknown, the end mark stops decoding */
+	if (size > *unc_len)
+		size = *unc_len;
+
+	LzmaDec_Construct(&state);
+	if (LzmaDec_AllocateProbs(&state, src, LZMA_PROPS_SIZE,
+				  &bootm_stream_lzma) != SZ_OK) {
+		puts ("LZMA: out of memory\n");
+		return -1;
+	}
+	state.dic = load;
+	state.dicBufSize = (SizeT)size;
+	LzmaDec_Init(&state);
+
+	bs->pos += LZMA_PROPS_SIZE + 8;
+	r = SZ_OK;
+	while (state.dicPos < (SizeT)size) {
+		if (bs->pos == bs->len && !bootm_stream_fill(bs)) {
+			r = SZ_ERROR_INPUT_EOF;
+			break;
+		}
+		srclen = bs->len - bs->pos;
+		start = get_timer(0);
+		r = LzmaDec_DecodeToDic(&state, (SizeT)size,
+					bs->buf + bs->pos, &srclen,
+					LZMA_FINISH_ANY, &status);
+		bs->unc_ms += get_timer(start);
+		bs->pos += srclen;
+		if (r != SZ_OK || status == LZMA_STATUS_FINISHED_WITH_MARK)
+			break;
+		if (srclen == 0 && status != LZMA_STATUS_NEEDS_MORE_INPUT) {
+			r = SZ_ERROR_DATA;
+			break;
+		}
+	}
+	*unc_len = state.dicPos;
+	LzmaDec_FreeProbs(&state, &bootm_stream_lzma);
+
+	if (r != SZ_OK) {
+		printf ("LZMA: uncompress error %d\n", r);
+		return -1;
+	}
+	return 0;
+}
+#endif /* CONFIG_LZMA */
+
+#ifdef CONFIG_CMD_NAND
+static int bootm_stream_nand_read(void *handle, unsigned long long offset,
+				  unsigned int length, unsigned char *buf)
+{
+	return nand_logic_read(handle, offset, length, buf, 0);
+}
+#endif
+
+#ifdef CONFIG_CMD_MMC
+static int bootm_stream_emmc_read(void *handle, unsigned long long offset,
+				  unsigned int length, unsigned char *buf)
+{
+	return emmc_logic_read(handle, offset, length, buf);
+}
+#endif
+
+#ifdef CONFIG_CMD_SF
+static int bootm_stream_sf_read(void *handle, unsigned long long offset,
+				unsigned int length, unsigned char *buf)
+{
+	return spiflash_logic_read(handle, offset, length, buf);
+}
+#endif
+
+static int bootm_stream_open(struct bootm_stream *bs, const char *media,
+			     unsigned long long address,
+			     unsigned long long length)
+{
+#ifdef CONFIG_CMD_NAND
+	if (!strcmp(media, "nand")) {
+		nand_logic_t *nand_logic = nand_logic_open(address, length);
+
+		if (!nand_logic)
+			return -1;
+		bs->handle = nand_logic;
+		bs->read = bootm_stream_nand_read;
+		bs->align = nand_logic->nand->writesize;
+		return 0;
+	}
+#endif
+#ifdef CONFIG_CMD_MMC
+	if (!strcmp(media, "emmc")) {
+		emmc_logic_t *emmc_logic = emmc_logic_open(address, length);
+
+		if (!emmc_logic)
+			return -1;
+		bs->handle = emmc_logic;
+		bs->read = bootm_stream_emmc_read;
+		bs->align = emmc_logic->blocksize;
+		return 0;
+	}
+#endif
+#ifdef CONFIG_CMD_SF
+	if (!strcmp(media, "sf")) {
+		spiflash_logic_t *spiflash_logic =
+			spiflash_logic_open(address, length);
+
+		if (!spiflash_logic)
+			return -1;
+		bs->handle = spiflash_logic;
+		bs->read = bootm_stream_sf_read;
+		bs->align = 1;
+		return 0;
+	}
+#endif
+	printf ("Unknown flash type '%s'\n", media);
+	return -1;
+}
+
+static void bootm_stream_close(struct bootm_stream *bs, const char *media)
+{
+#ifdef CONFIG_CMD_NAND
+	if (!strcmp(media, "nand"))
+		nand_logic_close(bs->handle);
+#endif
+#ifdef CONFIG_CMD_MMC
+	if (!strcmp(media, "emmc"))
+		emmc_logic_close(bs->handle);
+#endif
+#ifdef CONFIG_CMD_SF
+	if (!strcmp(media, "sf"))
+		spiflash_logic_close(bs->handle);
+#endif
+}
+
+/* the whole image to "loadaddr", for bootm */
+static int bootm_stream_to_ram(struct bootm_stream *bs, ulong addr)
+{
+	uchar *dst = (uchar *)addr;
+	unsigned int length;
+
+	memcpy (dst, bs->buf, bs->len);
+	dst += bs->len;
+	while (bs->data_left) {
+		length = bootm_stream_fill(bs);
+		if (!length)
+			return -1;
+		memcpy (dst, bs->buf, length);
+		dst += length;
+	}
+	return 0;
+}
+
+/* load the kernel, returns the BOOTM_ERR_* of bootm_load_os() */
+static int bootm_stream_load_os(struct bootm_stream *bs, ulong *load_end)
+{
+	const char *type_name = genimg_get_type_name (images.os.type);
+	uchar *load = (uchar *)images.os.load;
+	ulong unc_len = CONFIG_SYS_BOOTM_LEN;
+	int ret;
+
+	if (bootm_check_overwrite(images.os.load, images.os.image_len))
+		return BOOTM_ERR_RESET;
+
+	switch (images.os.comp) {
+	case IH_COMP_NONE:
+		printf ("   Loading %s ... ", type_name);
+		ret = bootm_stream_none(bs, load, &unc_len);
+		break;
+#ifdef CONFIG_GZIP
+	case IH_COMP_GZIP:
+		printf ("   Uncompressing %s ... ", type_name);
+		ret = bootm_stream_gzip(bs, load, &unc_len);
+		break;
+#endif
+#ifdef CONFIG_LZMA
+	case IH_COMP_LZMA:
+		printf ("   Uncompressing %s ... ", type_name);
+		ret = bootm_stream_lzma_dec(bs, load, &unc_len);
+		break;
+#endif
+	default:
+		return BOOTM_ERR_UNIMPLEMENTED;
+	}
+	if (!ret)
+		ret = bootm_stream_drain(bs);
+	if (ret) {
+		puts ("- must RESET board to recover\n");
+		show_boot_progress (-6);
+		return BOOTM_ERR_RESET;
+	}
+	puts ("OK\n");
+
+	if (bs->verify) {
+		puts ("   Verifying Checksum ... ");
+		if (bs->dcrc != image_get_dcrc (&images.legacy_hdr_os_copy)) {
+			printf ("Bad Data CRC\n");
+			show_boot_progress (-3);
+			return BOOTM_ERR_RESET;
+		}
+		puts ("OK\n");
+	}
+	show_boot_progress (7);
+
+	*load_end = images.os.load + unc_len;
+	return 0;
+}
+
+int do_bootm_stream (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	struct bootm_stream bs;
+	image_header_t *hdr = &images.legacy_hdr_os_copy;
+	unsigned long long address, length;
+	ulong start, total_ms, iflag;
+	ulong load_end = 0;
+	unsigned int n, first;
+	boot_os_fn *boot_fn;
+	char *args[3], addr[16];
+	int ret;
+
+	if (argc < 4) {
+		cmd_usage(cmdtp);
+		return 1;
+	}
+	address = simple_strtoull(argv[2], NULL, 16);
+	length = simple_strtoull(argv[3], NULL, 16);
+
+	memset (&bs, 0, sizeof(bs));
+	if (bootm_stream_open(&bs, argv[1], address, length))
+		return 1;
+	if ((bs.buf = malloc(CONFIG_BOOTM_STREAM_CHUNK)) == NULL) {
+		puts ("Out of memory\n");
+		bootm_stream_close(&bs, argv[1]);
+		return 1;
+	}
+
+	memset ((void *)&images, 0, sizeof (images));
+	images.verify = getenv_yesno ("verify");
+	bootm_start_lmb();
+
+	start = get_timer(0);
+
+	/* the first chunk, with the image header */
+	printf ("## Booting kernel from %s at 0x%08llx ...\n", argv[1], address);
+	first = CONFIG_BOOTM_STREAM_CHUNK;
+	if (first > length)
+		first = length;
+	bs.data_left = first;
+	if (first < image_get_header_size ()
+	    || bootm_stream_read(&bs, bs.buf, first))
+		goto fail;
+	memcpy (hdr, bs.buf, image_get_header_size ());
+	if (!image_check_magic (hdr)) {
+		puts ("Bad Magic Number\n");
+		show_boot_progress (-1);
+		goto fail;
+	}
+	if (!image_check_hcrc (hdr)) {
+		puts ("Bad Header Checksum\n");
+		show_boot_progress (-2);
+		goto fail;
+	}
+	image_print_contents (hdr);
+	if (!image_check_target_arch (hdr)
+	    || image_get_type (hdr) != IH_TYPE_KERNEL) {
+		printf ("Wrong Image Type for %s command\n", cmdtp->name);
+		show_boot_progress (-5);
+		goto fail;
+	}
+
+	images.legacy_hdr_os = hdr;
+	images.legacy_hdr_valid = 1;
+	images.os.type = image_get_type (hdr);
+	images.os.comp = image_get_comp (hdr);
+	images.os.os = image_get_os (hdr);
+	images.os.load = image_get_load (hdr);
+	images.os.image_len = image_get_data_size (hdr);
+	images.ep = image_get_ep (hdr);
+
+	/* the data part of the first chunk */
+	n = first - image_get_header_size ();
+	if (n > images.os.image_len)
+		n = images.os.image_len;
+	bs.verify = images.verify;
+	bs.dcrc = bs.verify ?
+		bootm_stream_crc32 (0, bs.buf + image_get_header_size (), n) : 0;
+	bs.pos = image_get_header_size ();
+	bs.len = bs.pos + n;
+	bs.data_left = images.os.image_len - n;
+
+	/* as bootm, the kernel may overwrite the exception vectors */
+	iflag = disable_interrupts();
+#if defined(CONFIG_CMD_USB)
+	usb_stop();
+#endif
+
+	ret = bootm_stream_load_os(&bs, &load_end);
+	if (ret == BOOTM_ERR_UNIMPLEMENTED) {
+		/* not streamable: the old way, through RAM */
+		printf ("   %s can not be streamed, loading to 0x%08lx\n",
+			genimg_get_comp_name (images.os.comp), load_addr);
+		bs.verify = 0;
+		ret = bootm_stream_to_ram(&bs, load_addr);
+		free(bs.buf);
+		bootm_stream_close(&bs, argv[1]);
+		if (iflag)
+			enable_interrupts();
+		if (ret)
+			return 1;
+		sprintf (addr, "%lx", load_addr);
+		args[0] = "bootm";
+		args[1] = addr;
+		args[2] = NULL;
+		return do_bootm (cmdtp, flag, 2, args);
+	}
+	free(bs.buf);
+	bootm_stream_close(&bs, argv[1]);
+	if (ret == BOOTM_ERR_RESET)
+		do_reset (cmdtp, flag, argc, argv);
+
+	total_ms = get_timer(start);
+	printf ("   read %lu ms, uncompress %lu ms, total %lu ms "
+		"(%lu KiB -> %lu KiB)\n", bs.read_ms, bs.unc_ms, total_ms,
+		images.os.image_len >> 10, (load_end - images.os.load) >> 10);
+	bootstage_mark("bootm_load_os");
+
+	lmb_reserve(&images.lmb, images.os.load, (load_end - images.os.load));
+
+	show_boot_progress (8);
+	bootm_reloc_boot_os();
+	boot_fn = boot_os[images.os.os];
+	if (boot_fn == NULL) {
+		if (iflag)
+			enable_interrupts();
+		printf ("ERROR: booting os '%s' (%d) is not supported\n",
+			genimg_get_os_name(images.os.os), images.os.os);
+		show_boot_progress (-8);
+		return 1;
+	}
+
+	bootstage_mark("start_kernel");
+	bootstage_stash();
+	arch_preboot_os();
+
+	boot_fn(0, 1, argv, &images);
+
+	show_boot_progress (-9);
+	do_reset (cmdtp, flag, argc, argv);
+	return 1;
+
+fail:
+	free(bs.buf);
+	bootm_stream_close(&bs, argv[1]);
+	return 1;
+}
+
+U_BOOT_CMD(
+	bootms,	4,	1,	do_bootm_stream,
+	"boot a kernel image streamed from flash",
+	"nand|emmc|sf offset size\n"
+	"    - read the image from the flash partition at 'offset' of 'size'\n"
+	"      bytes and uncompress it while reading, then boot it\n"
+	"    - prints the time spent reading, uncompressing and in total"
+);
+#endif /* CONFIG_BOOTM_STREAM */
+
 /*******************************************************************/
 /* bootd - boot default image */
 /*******************************************************************/
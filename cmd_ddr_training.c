@@ -9,6 +9,7 @@
 #include <common.h>
 #include <command.h>
 #include <asm/io.h>
+#include "bootstage.h"
 
 struct regval_t {
 	unsigned int reg;
@@ -166,7 +167,7 @@ int ddr_training(void)
 int check_ddr_training(void)
 {
 #ifdef CONFIG_DDR_TRAINING_STARTUP
-	int ix;
+	int ix, ret;
 	char *s = getenv("unddrtr");
 
 	if (s && (*s == 'y' || *s == 'Y'))
@@ -176,12 +177,16 @@ int check_ddr_training(void)
 	if (get_ddrtr_result_by_env(&ddrtr_result)) {
 		/* ddr training function will set value to ddr register. */
 
-		if (ddr_training())
+		ret = ddr_training();
+		bootstage_mark("ddr_training");
+		if (ret)
 			return 0;
 
 		setenv(DDR_TRAINING_ENV,
 			dump_ddrtr_result(&ddrtr_result, ' '));
-		return do_saveenv(NULL, 0, 0, NULL);
+		ret = do_saveenv(NULL, 0, 0, NULL);
+		bootstage_mark("ddr_training_save");
+		return ret;
 	}
 
 	printf("Set training value to DDR controller\n");
@@ -189,6 +194,7 @@ int check_ddr_training(void)
 		writel(ddrtr_result.reg[ix].val,
 			ddrtr_result.reg[ix].reg);
 	}
+	bootstage_mark("ddr_training");
 #endif /* CONFIG_DDR_TRAINING_STARTUP */
 
 	return 0;
@@ -37,6 +37,25 @@
 #include <u-boot/md5.h>
 #include <sha1.h>
 
+#ifdef CONFIG_CMD_UNZIP
+#include <image.h>
+#include "image_comp.h"
+#ifdef CONFIG_BZIP2
+#include <bzlib.h>
+#endif
+#ifdef CONFIG_LZMA
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+#include <lzma/LzmaTools.h>
+#endif
+#ifdef CONFIG_LZO
+#include <linux/lzo.h>
+#endif
+#ifdef CONFIG_LZ4
+extern int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
+#endif
+#endif /* CONFIG_CMD_UNZIP */
+
 #ifdef	CMD_MEM_DEBUG
 #define	PRINTF(fmt,args...)	printf (fmt ,##args)
 #else
@@ -1225,10 +1244,103 @@ int do_sha1sum(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 #endif
 
 #ifdef CONFIG_CMD_UNZIP
+/*
+ * Uncompress "srclen" bytes at "src" to "dst", "*dstlen" is the room at
+ * "dst" and returns the uncompressed size. Returns 0, -1 for corrupt
+ * data or no room, -2 when the compression is not built in.
+ * Also used by unzipbench.
+ */
+int unzip_comp(uint8_t comp, void *dst, ulong *dstlen, void *src,
+	       ulong srclen)
+{
+	switch (comp) {
+	case IH_COMP_NONE:
+		if (srclen > *dstlen)
+			return -1;
+		memmove(dst, src, srclen);
+		*dstlen = srclen;
+		return 0;
+	case IH_COMP_GZIP: {
+		unsigned long len = srclen;
+
+		if (gunzip(dst, *dstlen, src, &len))
+			return -1;
+		*dstlen = len;
+		return 0;
+	}
+#ifdef CONFIG_BZIP2
+	case IH_COMP_BZIP2: {
+		unsigned int len = *dstlen;
+
+		if (BZ2_bzBuffToBuffDecompress(dst, &len, src, srclen,
+				CONFIG_SYS_MALLOC_LEN < (4096 * 1024), 0) != BZ_OK)
+			return -1;
+		*dstlen = len;
+		return 0;
+	}
+#endif /* CONFIG_BZIP2 */
+#ifdef CONFIG_LZMA
+	case IH_COMP_LZMA: {
+		SizeT len = *dstlen;
+
+		if (lzmaBuffToBuffDecompress(dst, &len, src, srclen) != SZ_OK)
+			return -1;
+		*dstlen = len;
+		return 0;
+	}
+#endif /* CONFIG_LZMA */
+#ifdef CONFIG_LZO
+	case IH_COMP_LZO: {
+		size_t len = *dstlen;
+
+		if (lzop_decompress(src, srclen, dst, &len) != LZO_E_OK)
+			return -1;
+		*dstlen = len;
+		return 0;
+	}
+#endif /* CONFIG_LZO */
+#ifdef CONFIG_LZ4
+	case IH_COMP_LZ4: {
+		size_t len = *dstlen;
+
+		if (ulz4fn(src, srclen, dst, &len))
+			return -1;
+		*dstlen = len;
+		return 0;
+	}
+#endif /* CONFIG_LZ4 */
+	}
+	return -2;
+}
+
+/* the compression of raw compressed data, -1 if unknown */
+static int unzip_detect(const uchar *p)
+{
+	static const uchar lzop_magic[] = { 0x89, 'L', 'Z', 'O', 0 };
+
+	if (p[0] == 0x1f && p[1] == 0x8b)
+		return IH_COMP_GZIP;
+	if (p[0] == 'B' && p[1] == 'Z' && p[2] == 'h')
+		return IH_COMP_BZIP2;
+	if (!memcmp(p, lzop_magic, sizeof(lzop_magic)))
+		return IH_COMP_LZO;
+	if ((p[0] == 0x04 && p[1] == 0x22 && p[2] == 0x4d && p[3] == 0x18)
+	    || (p[0] == 0x02 && p[1] == 0x21 && p[2] == 0x4c && p[3] == 0x18))
+		return IH_COMP_LZ4;
+	if (p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd)
+		return IH_COMP_ZSTD;
+	/* lzma has no magic, the usual properties and a small dictionary */
+	if (p[0] == 0x5d && p[1] == 0)
+		return IH_COMP_LZMA;
+	return -1;
+}
+
 int do_unzip ( cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 {
 	unsigned long src, dst;
 	unsigned long src_len = ~0UL, dst_len = ~0UL;
+	char *s;
+	int comp, ret;
 
 	switch (argc) {
 		case 4:
@@ -1243,7 +1355,22 @@ int do_unzip ( cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 			return 1;
 	}
 
-	return !!gunzip((void *) dst, dst_len, (void *) src, &src_len);
+	comp = unzip_detect((uchar *)src);
+	if (comp == IH_COMP_GZIP || comp < 0)	/* gunzip as always */
+		return !!gunzip((void *) dst, dst_len, (void *) src, &src_len);
+
+	/* the others may need to know where the data ends */
+	s = getenv("filesize");
+	src_len = s ? simple_strtoul(s, NULL, 16) : ~0UL - src;
+	if (dst_len > ~0UL - dst)
+		dst_len = ~0UL - dst;
+
+	ret = unzip_comp(comp, (void *)dst, &dst_len, (void *)src, src_len);
+	if (ret == -2)
+		printf("%s not supported\n", genimg_get_comp_name(comp));
+	else if (ret)
+		printf("%s: uncompress error\n", genimg_get_comp_name(comp));
+	return !!ret;
 }
 #endif /* CONFIG_CMD_UNZIP */
 
@@ -1367,6 +1494,8 @@ U_BOOT_CMD(
 U_BOOT_CMD(
 	unzip,	4,	1,	do_unzip,
 	"unzip a memory region",
-	"srcaddr dstaddr [dstsize]"
+	"srcaddr dstaddr [dstsize]\n"
+	"    - gzip, bzip2, lzma, lzo or lz4, from the magic at 'srcaddr'.\n"
+	"      For all but gzip the compressed size is 'filesize'."
 );
 #endif /* CONFIG_CMD_UNZIP */
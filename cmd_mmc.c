@@ -25,6 +25,8 @@
 #include <command.h>
 #include <mmc.h>
 
+#include "fit_cache.h"
+
 extern int select_boot_part(struct mmc *mmc, int boot_part);
 extern void emmc_bootmode_read(void *ptr, unsigned int size);
 extern int print_mmc_reg(int dev_num, int show_ext_csd);
@@ -222,7 +224,11 @@ int do_mmcops(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 
 			mmc_init(mmc);
 
+			fit_cache_note_write("emmc",
+				(unsigned long long)blk * mmc->write_bl_len,
+				(unsigned long long)cnt * mmc->write_bl_len);
 			n = mmc->block_dev.block_write(dev, blk, cnt, addr);
+			fit_cache_note_done();
 
 			printf("%d blocks written: %s\n",
 				n, (n == cnt) ? "OK" : "ERROR");
@@ -17,6 +17,8 @@
 #include <jffs2/jffs2.h>
 #include <nand.h>
 
+#include "fit_cache.h"
+
 #if defined(CONFIG_CMD_MTDPARTS)
 
 /* partition handling routines */
@@ -360,7 +362,9 @@ int do_nand(cmd_tbl_t * cmdtp, int flag, int argc, char *argv[])
 				return -1;
 			}
 		}
+		fit_cache_note_write("nand", off, size);
 		ret = nand_erase_opts(nand, &opts);
+		fit_cache_note_done();
 		printf("%s\n", ret ? "ERROR" : "OK");
 
 		return ret == 0 ? 0 : 1;
@@ -421,8 +425,10 @@ int do_nand(cmd_tbl_t * cmdtp, int flag, int argc, char *argv[])
 					return 1;
 				}
 
+				fit_cache_note_write("nand", off, rw_size);
 				ret = nand_write_skip_bad(nand, off, &rw_size,
 							  (u_char *)addr);
+				fit_cache_note_done();
 			}
 		} else if (!strcmp(s, ".oob")) {
 			/* out-of-band data */
@@ -444,16 +450,21 @@ int do_nand(cmd_tbl_t * cmdtp, int flag, int argc, char *argv[])
 				if (yaffs_check((unsigned char *)addr, nand->writesize, size))
 					return 1;
 
+				fit_cache_note_write("nand", off, rw_size);
 				ret = nand_write_yaffs_skip_bad(nand, off, &rw_size,
 					(u_char *)addr);
+				fit_cache_note_done();
 			}
 		} else if (s != NULL && !strcmp(s, ".yaffsuc")) {
 			if (read) {
 				printf("not support\n");
 				return 1;
-			} else
+			} else {
+				fit_cache_note_write("nand", off, rw_size);
 				ret = nand_write_yaffs_skip_bad(nand, off,
 					&rw_size, (u_char *)addr);
+				fit_cache_note_done();
+			}
 		} else {
 			printf("Unknown nand command suffix '%s'.\n", s);
 			return 1;
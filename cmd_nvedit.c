@@ -31,8 +31,10 @@
  * The "environment" is stored as a list of '\0' terminated
  * "name=value" strings. The end of the list is marked by a double
  * '\0'. New entries are always added at the end. Deleting an entry
- * shifts the remaining entries to the front. Replacing an entry is a
- * combination of deleting the old value and adding the new one.
+ * in RAM only marks it dead (see ENV_TOMBSTONE), dead entries are
+ * squeezed out when the space runs out or before the CRC is
+ * calculated for saving. Replacing an entry is a combination of
+ * deleting the old value and adding the new one.
  *
  * The environment is preceeded by a 32 bit CRC over the data part.
  *
@@ -94,6 +96,198 @@ int get_env_id (void)
 {
 	return env_id;
 }
+/************************************************************************
+ * Hash index over the in-RAM environment, name -> offset of the
+ * "name=value" string in the env data. Linear probing, a slot holds
+ * offset + 1, 0 is an empty slot. The index is only used after
+ * relocation, when the env data lives in RAM; it is (re)built lazily
+ * whenever the env data moved, and kept up to date by _do_setenv().
+ * If it fills up, lookups fall back to scanning the env data.
+ */
+#ifndef CONFIG_ENV_HASH_SIZE
+#define CONFIG_ENV_HASH_SIZE	512	/* MUST be power of 2 */
+#endif
+#define ENV_HASH_MASK		(CONFIG_ENV_HASH_SIZE - 1)
+#define ENV_HASH_MAX		(CONFIG_ENV_HASH_SIZE * 3 / 4)
+
+/*
+ * First byte of a deleted entry. '=' can not start a variable name, so
+ * no lookup matches it.
+ */
+#define ENV_TOMBSTONE		'='
+
+static int env_hash[CONFIG_ENV_HASH_SIZE];
+static int env_hash_count;
+static uchar *env_hash_base;	/* env data the index was built for */
+static int env_hash_full;	/* too many variables, index not usable */
+static int env_hash_end;	/* offset of the closing '\0' */
+static int env_hash_dead;	/* bytes of deleted entries */
+
+static unsigned int env_hash_name (const uchar *name)
+{
+	unsigned int h = 5381;
+
+	while (*name != '\0' && *name != '=')
+		h = h * 33 + *name++;
+	return h;
+}
+
+/* 1 if "var" (a "name=value" string) is variable "name" */
+static int env_hash_match (const uchar *name, const uchar *var)
+{
+	while (*name != '\0' && *name != '=' && *name == *var) {
+		++name;
+		++var;
+	}
+	return (*name == '\0' || *name == '=') && *var == '=';
+}
+
+/* slot of variable "name", or the empty slot it would go to */
+static int *env_hash_slot (const uchar *name)
+{
+	unsigned int ix = env_hash_name(name) & ENV_HASH_MASK;
+
+	while (env_hash[ix]) {
+		if (env_hash_match(name, env_hash_base + env_hash[ix] - 1))
+			break;
+		ix = (ix + 1) & ENV_HASH_MASK;
+	}
+	return &env_hash[ix];
+}
+
+static void env_hash_insert (int *slot, int offset)
+{
+	if (*slot) {
+		*slot = offset + 1;
+		return;
+	}
+	if (env_hash_count >= ENV_HASH_MAX) {
+		env_hash_full = 1;
+		return;
+	}
+	*slot = offset + 1;
+	env_hash_count++;
+}
+
+/* remove a slot, move later entries of the probe chain back */
+static void env_hash_remove (int *slot)
+{
+	unsigned int ix = slot - env_hash;
+	unsigned int jx = ix;
+	unsigned int home;
+
+	env_hash_count--;
+	for (;;) {
+		env_hash[ix] = 0;
+		do {
+			jx = (jx + 1) & ENV_HASH_MASK;
+			if (!env_hash[jx])
+				return;
+			home = env_hash_name(env_hash_base + env_hash[jx] - 1)
+				& ENV_HASH_MASK;
+		} while ((ix <= jx) ? (ix < home && home <= jx)
+				    : (ix < home || home <= jx));
+		env_hash[ix] = env_hash[jx];
+		ix = jx;
+	}
+}
+
+void env_hash_invalidate (void)
+{
+	env_hash_base = NULL;
+}
+
+void env_hash_build (void)
+{
+	uchar *env_data;
+	int i, nxt;
+
+	env_hash_base = NULL;
+	if (!(gd->flags & GD_FLG_RELOC) || !(env_data = env_get_addr(0)))
+		return;
+
+	memset(env_hash, 0, sizeof(env_hash));
+	env_hash_count = 0;
+	env_hash_full  = 0;
+	env_hash_dead  = 0;
+	env_hash_base  = env_data;
+
+	for (i = 0; i < ENV_SIZE && env_data[i] != '\0'; i = nxt + 1) {
+		int *slot;
+
+		for (nxt = i; nxt < ENV_SIZE && env_data[nxt] != '\0'; ++nxt)
+			;
+		if (nxt >= ENV_SIZE) {
+			/* not terminated, leave it to the scan */
+			env_hash_full = 1;
+			return;
+		}
+		if (env_data[i] == ENV_TOMBSTONE) {
+			env_hash_dead += nxt + 1 - i;
+			continue;
+		}
+		/* the first definition of a name wins, like the scan */
+		slot = env_hash_slot(env_data + i);
+		if (!*slot)
+			env_hash_insert(slot, i);
+	}
+	env_hash_end = i;
+}
+
+/*
+ * Squeeze the deleted entries out of the in-RAM env data. The freed
+ * space is cleared, so the data (and its CRC) only depends on the
+ * variables.
+ */
+void env_compact (void)
+{
+	uchar *env_data, *src, *dst;
+
+	if (!(gd->flags & GD_FLG_RELOC) || !(env_data = env_get_addr(0)))
+		return;
+	if (env_hash_base == env_data && !env_hash_full && !env_hash_dead)
+		return;
+
+	src = dst = env_data;
+	while (src < &env_data[ENV_SIZE] && *src != '\0') {
+		int len = strnlen((char *)src, &env_data[ENV_SIZE] - src) + 1;
+
+		if (*src != ENV_TOMBSTONE) {
+			if (dst != src)
+				memmove(dst, src, len);
+			dst += len;
+		}
+		src += len;
+	}
+	if (dst != src)
+		env_id++;	/* values returned by getenv() moved */
+	if (src > &env_data[ENV_SIZE - 1])
+		src = &env_data[ENV_SIZE - 1];
+
+	/* end is marked with double '\0' */
+	if (dst == env_data)
+		*dst++ = '\0';
+	if (src >= dst)
+		memset(dst, 0, src - dst + 1);
+
+	env_hash_build();
+}
+
+/* env data if the index can be used, else NULL */
+static uchar *env_hash_ready (void)
+{
+	uchar *env_data;
+
+	if (!(gd->flags & GD_FLG_RELOC))
+		return NULL;
+
+	env_data = env_get_addr(0);
+	if (env_hash_base != env_data)
+		env_hash_build();
+
+	return (env_hash_base && !env_hash_full) ? env_hash_base : NULL;
+}
+
 /************************************************************************
  * Command interface: print one or all environment variables
  */
@@ -212,6 +406,12 @@ static int printenv(char *name, int state)
 	buf[16] = '\0';
 
 	while (state && env_get_char(i) != '\0') {
+		if (env_get_char(i) == ENV_TOMBSTONE) {
+			while (env_get_char(i++) != '\0')
+				;
+			continue;
+		}
+
 		if (state == 2 && envmatch((uchar *)name, i) >= 0)
 			state = 0;
 
@@ -278,6 +478,7 @@ int _do_setenv (int flag, int argc, char *argv[])
 {
 	int   i, len, oldval;
 	int   console = -1;
+	int   *slot;
 	uchar *env, *nxt = NULL;
 	char *name;
 	bd_t *bd = gd->bd;
@@ -299,11 +500,21 @@ int _do_setenv (int flag, int argc, char *argv[])
 	 * search if variable with this name already exists
 	 */
 	oldval = -1;
-	for (env=env_data; *env; env=nxt+1) {
-		for (nxt=env; *nxt; ++nxt)
-			;
-		if ((oldval = envmatch((uchar *)name, env-env_data)) >= 0)
-			break;
+	if (env_hash_ready() == env_data) {
+		slot = env_hash_slot((uchar *)name);
+		if (*slot) {
+			env = env_data + *slot - 1;
+			nxt = env + strlen((char *)env);
+			oldval = envmatch((uchar *)name, env-env_data);
+		}
+	} else {
+		slot = NULL;
+		for (env=env_data; *env; env=nxt+1) {
+			for (nxt=env; *nxt; ++nxt)
+				;
+			if ((oldval = envmatch((uchar *)name, env-env_data)) >= 0)
+				break;
+		}
 	}
 
 	/* Check for console redirection */
@@ -395,21 +606,28 @@ int _do_setenv (int flag, int argc, char *argv[])
 			}
 		}
 
-		if (*++nxt == '\0') {
-			if (env > env_data) {
-				env--;
-			} else {
-				*env = '\0';
-			}
+		if (slot) {
+			/* leave it in place, env_compact() drops it later */
+			env_hash_remove(slot);
+			*env = ENV_TOMBSTONE;
+			env_hash_dead += nxt + 1 - env;
 		} else {
-			for (;;) {
-				*env = *nxt++;
-				if ((*env == '\0') && (*nxt == '\0'))
-					break;
-				++env;
+			if (*++nxt == '\0') {
+				if (env > env_data) {
+					env--;
+				} else {
+					*env = '\0';
+				}
+			} else {
+				for (;;) {
+					*env = *nxt++;
+					if ((*env == '\0') && (*nxt == '\0'))
+						break;
+					++env;
+				}
 			}
+			*++env = '\0';
 		}
-		*++env = '\0';
 	}
 
 	/* Delete only ? */
@@ -423,13 +641,6 @@ int _do_setenv (int flag, int argc, char *argv[])
 		return 0;
 	}
 
-	/*
-	 * Append new definition at the end
-	 */
-	for (env=env_data; *env || *(env+1); ++env)
-		;
-	if (env > env_data)
-		++env;
 	/*
 	 * Overflow when:
 	 * "name" + "=" + "val" +"\0\0"  > ENV_SIZE - (env-env_data)
@@ -439,10 +650,28 @@ int _do_setenv (int flag, int argc, char *argv[])
 	for (i=2; i<argc; ++i) {
 		len += strlen(argv[i]) + 1;
 	}
+
+	/*
+	 * Append new definition at the end
+	 */
+	if (slot) {
+		env = env_data + env_hash_end;
+		if (len > (&env_data[ENV_SIZE]-env) && env_hash_dead) {
+			env_compact();
+			env = env_data + env_hash_end;
+		}
+	} else {
+		for (env=env_data; *env || *(env+1); ++env)
+			;
+		if (env > env_data)
+			++env;
+	}
 	if (len > (&env_data[ENV_SIZE]-env)) {
 		printf ("## Error: environment overflow, \"%s\" deleted\n", name);
 		return 1;
 	}
+	if (slot)
+		env_hash_insert(env_hash_slot((uchar *)name), env - env_data);
 	while ((*env = *name++) != '\0')
 		env++;
 	for (i=2; i<argc; ++i) {
@@ -455,6 +684,8 @@ int _do_setenv (int flag, int argc, char *argv[])
 
 	/* end is marked with double '\0' */
 	*++env = '\0';
+	if (slot)
+		env_hash_end = env - env_data;
 
 	/* Update CRC */
 	/* 
@@ -656,6 +887,14 @@ char *getenv (char *name)
 
 	WATCHDOG_RESET();
 
+	if (env_hash_ready()) {
+		int *slot = env_hash_slot((uchar *)name);
+
+		if (!*slot)
+			return (NULL);
+		return ((char *)env_get_addr(envmatch((uchar *)name, *slot - 1)));
+	}
+
 	for (i=0; env_get_char(i) != '\0'; i=nxt+1) {
 		int val;
 
@@ -676,6 +915,21 @@ int getenv_r (char *name, char *buf, unsigned len)
 {
 	int i, nxt;
 
+	if (env_hash_ready()) {
+		int *slot = env_hash_slot((uchar *)name);
+		int val, n;
+
+		if (!*slot)
+			return (-1);
+		val = envmatch((uchar *)name, *slot - 1);
+		n = 0;
+		while ((len > n++) && (*buf++ = env_get_char(val++)) != '\0')
+			;
+		if (len == n)
+			*buf = '\0';
+		return (n);
+	}
+
 	for (i=0; env_get_char(i) != '\0'; i=nxt+1) {
 		int val, n;
 
@@ -699,12 +953,15 @@ int getenv_r (char *name, char *buf, unsigned len)
 
 #if defined(CONFIG_CMD_SAVEENV) && !defined(CONFIG_ENV_IS_NOWHERE)
 
-int do_saveenv (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
-{
-	extern char * env_name_spec;
-
-	printf ("Saving Environment to %s...\n", env_name_spec);
+extern int env_is_dirty (void);
+extern void env_mark_saved (void);
 
+/*
+ * saveenv without the messages, for code that saves the env by itself:
+ * updates the CRC, saves only if the env changed. Returns 0 or -1.
+ */
+int env_save (void)
+{
 	/* 
 	 * optimize uboot startup time, only do_saveenv command update CRC, 
 	 * so if you want do saveenv, you should call function env_crc_update() 
@@ -712,7 +969,30 @@ int do_saveenv (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 	 */
 	env_crc_update ();
 
-	return (saveenv() ? 1 : 0);
+	if (!env_is_dirty())
+		return 0;
+
+	if (saveenv())
+		return -1;
+
+	env_mark_saved();
+	return 0;
+}
+
+int do_saveenv (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	extern char * env_name_spec;
+
+	env_crc_update ();
+
+	if (!env_is_dirty()) {
+		printf ("Environment unchanged, not saved\n");
+		return 0;
+	}
+
+	printf ("Saving Environment to %s...\n", env_name_spec);
+
+	return env_save() ? 1 : 0;
 }
 
 U_BOOT_CMD(
@@ -723,6 +1003,49 @@ U_BOOT_CMD(
 
 #endif
 
+#if defined(CONFIG_CMD_ENV_BENCH)
+
+int do_env_bench (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	unsigned int i, count = 1000;
+	ulong start, ms;
+	char val[16];
+
+	if (argc > 1)
+		count = simple_strtoul(argv[1], NULL, 10);
+	if (!count) {
+		cmd_usage(cmdtp);
+		return 1;
+	}
+
+	start = get_timer(0);
+	for (i = 0; i < count; i++) {
+		sprintf(val, "%u", i);
+		if (setenv("envbench", val) || !getenv("envbench")) {
+			printf("## Error: setenv failed after %u cycles\n", i);
+			setenv("envbench", NULL);
+			return 1;
+		}
+	}
+	ms = get_timer(start);
+	setenv("envbench", NULL);
+
+	printf("%u setenv/getenv cycles in %lu ms", count, ms);
+	if (ms)
+		printf(", %lu cycles/s", (ulong)count * 1000 / ms);
+	printf("\n");
+	return 0;
+}
+
+U_BOOT_CMD(
+	envbench, 2, 0,	do_env_bench,
+	"time setenv/getenv of a scratch variable",
+	"[count]\n"
+	"    - set and read back variable 'envbench' 'count' times (default 1000)"
+);
+
+#endif /* CONFIG_CMD_ENV_BENCH */
+
 
 /************************************************************************
  * Match a name / name=value pair
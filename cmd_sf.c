@@ -11,6 +11,8 @@
 #include <asm/io.h>
 #include <linux/mtd/mtd.h>
 
+#include "fit_cache.h"
+
 #ifndef CONFIG_SF_DEFAULT_SPEED
 # define CONFIG_SF_DEFAULT_SPEED	1000000
 #endif
@@ -116,6 +118,7 @@ static int do_spi_flash_read_write(int argc, char *argv[])
 		write_len   = len;
 		write_step  = spiflash_info->erasesize;
 
+		fit_cache_note_write("sf", offset, len);
 		while (len > 0) {
 			if (len < write_step)
 				write_step = len;
@@ -148,6 +151,7 @@ static int do_spi_flash_read_write(int argc, char *argv[])
 				}
 			} while (0);
 		}
+		fit_cache_note_done();
 	}
 	puts("\n");
 
@@ -204,12 +208,14 @@ static int do_spi_flash_erase(int argc, char *argv[])
 	erase_len   = len;
 	erase_step  = spiflash_info->erasesize;
 
+	fit_cache_note_write("sf", offset, len);
 	while (len > 0) {
 		if (len < erase_step)
 			erase_step = len;
 
 		ret = spi_flash_erase(flash, offset, erase_step);
 		if (ret) {
+			fit_cache_note_done();
 			printf("SPI flash %s failed\n", argv[0]);
 			return 1;
 		}
@@ -237,6 +243,7 @@ static int do_spi_flash_erase(int argc, char *argv[])
 			}
 		} while (0);
 	}
+	fit_cache_note_done();
 	puts("\n");
 
 	return 0;
@@ -0,0 +1,99 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * unzipbench - time the decompressors of "unzip" on images of the same
+ * kernel made with "mkimage -C <comp>".
+ */
+
+#include <common.h>
+#include <command.h>
+#include <watchdog.h>
+#include <image.h>
+#include <div64.h>
+
+#if !defined(CONFIG_CMD_UNZIP) || !defined(CONFIG_CMD_MEMORY)
+#error "CONFIG_CMD_UNZIP_BENCH needs the unzip command of cmd_mem.c"
+#endif
+
+#ifndef CONFIG_SYS_BOOTM_LEN
+#define CONFIG_SYS_BOOTM_LEN	0x800000
+#endif
+
+#define UNZIP_BENCH_MS		1000	/* run each image at least so long */
+
+/* cmd_mem.c */
+extern int unzip_comp(uint8_t comp, void *dst, ulong *dstlen, void *src,
+		      ulong srclen);
+
+/*****************************************************************************/
+
+int do_unzip_bench(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	image_header_t *hdr;
+	void *dst;
+	ulong dstlen, srclen, start, ms, runs;
+	unsigned long long rate;
+	int ix, ret;
+	int err = 0;
+
+	if (argc < 3) {
+		cmd_usage(cmdtp);
+		return 1;
+	}
+	dst = (void *)simple_strtoul(argv[1], NULL, 16);
+
+	printf("%-8s %8s %8s %6s %6s %8s  %s\n", "comp", "in KiB",
+		"out KiB", "runs", "ms", "MB/s", "crc");
+	for (ix = 2; ix < argc; ix++) {
+		hdr = (image_header_t *)simple_strtoul(argv[ix], NULL, 16);
+		if (!image_check_magic(hdr) || !image_check_hcrc(hdr)) {
+			printf("%s: not an image\n", argv[ix]);
+			err = 1;
+			continue;
+		}
+		srclen = image_get_data_size(hdr);
+
+		runs = 0;
+		start = get_timer(0);
+		do {
+			dstlen = CONFIG_SYS_BOOTM_LEN;
+			ret = unzip_comp(image_get_comp(hdr), dst, &dstlen,
+					 (void *)image_get_data(hdr), srclen);
+			runs++;
+			WATCHDOG_RESET();
+		} while (!ret && get_timer(start) < UNZIP_BENCH_MS);
+		ms = get_timer(start);
+
+		if (ret) {
+			printf("%-8s %s\n",
+				genimg_get_comp_name(image_get_comp(hdr)),
+				ret == -2 ? "not supported" : "uncompress error");
+			err = 1;
+			continue;
+		}
+
+		/* output MB/s in tenths */
+		rate = (unsigned long long)dstlen * runs * 10;
+		do_div(rate, ms ? ms * 1000 : 1);
+		printf("%-8s %8lu %8lu %6lu %6lu %6lu.%lu  %08x\n",
+			genimg_get_comp_name(image_get_comp(hdr)),
+			srclen >> 10, dstlen >> 10, runs, ms,
+			(ulong)rate / 10, (ulong)rate % 10,
+			crc32(0, dst, dstlen));
+	}
+	return err;
+}
+
+U_BOOT_CMD(
+	unzipbench,	CONFIG_SYS_MAXARGS,	0,	do_unzip_bench,
+	"benchmark the decompressors",
+	"dstaddr imgaddr [imgaddr ...]\n"
+	"    - uncompress each legacy image to 'dstaddr' for a second and\n"
+	"      report the speed, the images should hold the same data\n"
+	"      compressed with different 'mkimage -C' types so the crc\n"
+	"      of the output matches."
+);
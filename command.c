@@ -27,6 +27,9 @@
 
 #include <common.h>
 #include <command.h>
+#include <malloc.h>
+
+DECLARE_GLOBAL_DATA_PTR;
 
 /*
  * Use puts() instead of printf() to avoid printf buffer overflow
@@ -98,9 +101,10 @@ int _do_help (cmd_tbl_t *cmd_start, int cmd_items, cmd_tbl_t * cmdtp, int
 }
 
 /***************************************************************************
- * find command table entry for a command
+ * find command table entry for a command, scanning the whole table
  */
-cmd_tbl_t *find_cmd_tbl (const char *cmd, cmd_tbl_t *table, int table_len)
+static cmd_tbl_t *find_cmd_scan (const char *cmd, cmd_tbl_t *table,
+				 int table_len)
 {
 	cmd_tbl_t *cmdtp;
 	cmd_tbl_t *cmdtp_temp = table;	/*Init value */
@@ -132,12 +136,149 @@ cmd_tbl_t *find_cmd_tbl (const char *cmd, cmd_tbl_t *table, int table_len)
 	return NULL;	/* not found or ambiguous command */
 }
 
+/***************************************************************************
+ * Index of the U_BOOT_CMD table sorted by name, built on first use after
+ * relocation (it needs malloc). Entries with the same name keep their
+ * table order, so the first one still wins like in the scan.
+ */
+static cmd_tbl_t **cmd_index;
+static int cmd_index_len;
+
+static int build_cmd_index (void)
+{
+	int ix, jx, len = &__u_boot_cmd_end - &__u_boot_cmd_start;
+	cmd_tbl_t *cmdtp;
+
+	if (cmd_index)
+		return 0;
+	if (!(gd->flags & GD_FLG_RELOC))
+		return -1;
+
+	cmd_index = (cmd_tbl_t **)malloc(len * sizeof(*cmd_index));
+	if (!cmd_index)
+		return -1;
+
+	/* insertion sort, stable and done only once */
+	for (ix = 0; ix < len; ix++) {
+		cmdtp = &__u_boot_cmd_start + ix;
+		for (jx = ix; jx > 0; jx--) {
+			if (strcmp(cmd_index[jx - 1]->name, cmdtp->name) <= 0)
+				break;
+			cmd_index[jx] = cmd_index[jx - 1];
+		}
+		cmd_index[jx] = cmdtp;
+	}
+	cmd_index_len = len;
+	return 0;
+}
+
+static cmd_tbl_t *find_cmd_index (const char *cmd)
+{
+	const char *p;
+	int len, low, high, mid;
+
+	len = ((p = strchr(cmd, '.')) == NULL) ? strlen (cmd) : (p - cmd);
+
+	/*
+	 * All names starting with the "len" chars of cmd are next to each
+	 * other, a full match sorts first among them.
+	 */
+	low  = 0;
+	high = cmd_index_len;
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (strncmp(cmd_index[mid]->name, cmd, len) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low == cmd_index_len || strncmp(cmd, cmd_index[low]->name, len))
+		return NULL;			/* not found */
+	if (cmd_index[low]->name[len] == '\0')
+		return cmd_index[low];		/* full match */
+	if (low + 1 < cmd_index_len
+	    && !strncmp(cmd, cmd_index[low + 1]->name, len))
+		return NULL;			/* ambiguous command */
+	return cmd_index[low];			/* exactly one match */
+}
+
+/***************************************************************************
+ * find command table entry for a command
+ */
+cmd_tbl_t *find_cmd_tbl (const char *cmd, cmd_tbl_t *table, int table_len)
+{
+	if (table == &__u_boot_cmd_start
+	    && table_len == &__u_boot_cmd_end - &__u_boot_cmd_start
+	    && !build_cmd_index())
+		return find_cmd_index(cmd);
+
+	return find_cmd_scan(cmd, table, table_len);
+}
+
 cmd_tbl_t *find_cmd (const char *cmd)
 {
 	int len = &__u_boot_cmd_end - &__u_boot_cmd_start;
 	return find_cmd_tbl(cmd, &__u_boot_cmd_start, len);
 }
 
+#if defined(CONFIG_CMD_FIND_BENCH)
+/*
+ * Look up every command by its full name and by its name less the last
+ * char, with the scan and with the index, and check both agree.
+ */
+int do_find_bench (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	int len = &__u_boot_cmd_end - &__u_boot_cmd_start;
+	unsigned int ix, round, rounds = 100;
+	char name[32];
+	ulong start, ms_scan, ms_index;
+
+	if (argc > 1)
+		rounds = simple_strtoul(argv[1], NULL, 10);
+	if (!rounds || build_cmd_index()) {
+		cmd_usage(cmdtp);
+		return 1;
+	}
+
+	for (ix = 0; ix < len; ix++) {
+		strncpy(name, (&__u_boot_cmd_start)[ix].name, sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+		if (find_cmd_index(name) != find_cmd_scan(name,
+				&__u_boot_cmd_start, len))
+			printf("mismatch for \"%s\"\n", name);
+		name[strlen(name) - 1] = '\0';
+		if (find_cmd_index(name) != find_cmd_scan(name,
+				&__u_boot_cmd_start, len))
+			printf("mismatch for \"%s\"\n", name);
+	}
+
+	start = get_timer(0);
+	for (round = 0; round < rounds; round++)
+		for (ix = 0; ix < len; ix++)
+			find_cmd_scan((&__u_boot_cmd_start)[ix].name,
+				&__u_boot_cmd_start, len);
+	ms_scan = get_timer(start);
+
+	start = get_timer(0);
+	for (round = 0; round < rounds; round++)
+		for (ix = 0; ix < len; ix++)
+			find_cmd_index((&__u_boot_cmd_start)[ix].name);
+	ms_index = get_timer(start);
+
+	printf("%u lookups of %d commands: scan %lu ms, index %lu ms\n",
+	       rounds * len, len, ms_scan, ms_index);
+	return 0;
+}
+
+U_BOOT_CMD(
+	findbench, 2, 0, do_find_bench,
+	"time command lookup, table scan against sorted index",
+	"[rounds]\n"
+	"    - look up every command 'rounds' times (default 100)"
+);
+#endif /* CONFIG_CMD_FIND_BENCH */
+
 int cmd_usage(cmd_tbl_t *cmdtp)
 {
 	printf("%s - %s\n\n", cmdtp->name, cmdtp->usage);
@@ -0,0 +1,188 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * CRC32 (the zlib/image CRC, polynomial 0xedb88320, reflected), eight
+ * bytes folded per step with slice-by-8 tables, the tail one byte at a
+ * time. Same value as crc32(), so it can verify any image:
+ *     crc = crc32_slice8(0, buf1, len1);
+ *     crc = crc32_slice8(crc, buf2, len2);
+ * The words are put together from bytes, so it does not care about
+ * alignment or byte order.
+ *
+ * "hashbench" times crc32() against it and the sha1/md5 of FIT images.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <watchdog.h>
+#include <div64.h>
+
+#ifdef CONFIG_CMD_HASH_BENCH
+#ifdef CONFIG_SHA1
+#include <sha1.h>
+#endif
+#ifdef CONFIG_MD5
+#include <u-boot/md5.h>
+#endif
+#endif /* CONFIG_CMD_HASH_BENCH */
+
+/*****************************************************************************/
+
+/* crc32_slice[n][x]: CRC of byte x followed by n zero bytes */
+static uint32_t crc32_slice[8][256];
+static int crc32_slice_ready;
+
+static void crc32_slice_init(void)
+{
+	uint32_t crc;
+	int n, x, k;
+
+	for (x = 0; x < 256; x++) {
+		crc = x;
+		for (k = 0; k < 8; k++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+		crc32_slice[0][x] = crc;
+	}
+	for (x = 0; x < 256; x++) {
+		crc = crc32_slice[0][x];
+		for (n = 1; n < 8; n++) {
+			crc = (crc >> 8) ^ crc32_slice[0][crc & 0xff];
+			crc32_slice[n][x] = crc;
+		}
+	}
+	crc32_slice_ready = 1;
+}
+/*****************************************************************************/
+
+uint32_t crc32_slice8(uint32_t crc, const unsigned char *buf,
+	unsigned int length)
+{
+	if (!crc32_slice_ready)
+		crc32_slice_init();
+
+	crc = ~crc;
+	for (; length >= 8; length -= 8, buf += 8) {
+		crc ^= buf[0] | (buf[1] << 8) | (buf[2] << 16)
+			| ((uint32_t)buf[3] << 24);
+		crc = crc32_slice[7][crc & 0xff]
+			^ crc32_slice[6][(crc >> 8) & 0xff]
+			^ crc32_slice[5][(crc >> 16) & 0xff]
+			^ crc32_slice[4][crc >> 24]
+			^ crc32_slice[3][buf[4]]
+			^ crc32_slice[2][buf[5]]
+			^ crc32_slice[1][buf[6]]
+			^ crc32_slice[0][buf[7]];
+	}
+	while (length--)
+		crc = (crc >> 8) ^ crc32_slice[0][(crc ^ *buf++) & 0xff];
+	return ~crc;
+}
+
+/* as crc32_wd(), the watchdog is kicked every "chunk_sz" bytes */
+uint32_t crc32_slice8_wd(uint32_t crc, const unsigned char *buf,
+	unsigned int length, unsigned int chunk_sz)
+{
+#if defined(CONFIG_HW_WATCHDOG) || defined(CONFIG_WATCHDOG)
+	unsigned int chunk;
+
+	while (length) {
+		chunk = (length > chunk_sz) ? chunk_sz : length;
+		crc = crc32_slice8(crc, buf, chunk);
+		buf += chunk;
+		length -= chunk;
+		WATCHDOG_RESET();
+	}
+	return crc;
+#else
+	return crc32_slice8(crc, buf, length);
+#endif
+}
+/*****************************************************************************/
+#ifdef CONFIG_CMD_HASH_BENCH
+
+static void hash_bench_report(const char *name, unsigned int length,
+	unsigned int loops, unsigned long ms)
+{
+	unsigned long long rate = (unsigned long long)length * loops * 10;
+
+	/* MB/s in tenths */
+	do_div(rate, ms ? ms * 1000 : 1);
+	printf("%-14s: %6lu ms, %5lu.%lu MB/s\n", name, ms,
+		(unsigned long)rate / 10, (unsigned long)rate % 10);
+}
+
+int do_hash_bench(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	const unsigned char *buf;
+	unsigned int length;
+	unsigned int loops = 1;
+	unsigned int ix;
+	uint32_t crc_lib = 0, crc_slice = 0;
+	unsigned long start;
+#ifdef CONFIG_SHA1
+	unsigned char sha1[20];
+#endif
+#ifdef CONFIG_MD5
+	unsigned char md5_sum[16];
+#endif
+
+	if (argc < 3) {
+		cmd_usage(cmdtp);
+		return 1;
+	}
+
+	buf    = (const unsigned char *)simple_strtoul(argv[1], NULL, 16);
+	length = simple_strtoul(argv[2], NULL, 16);
+	if (argc > 3)
+		loops = simple_strtoul(argv[3], NULL, 10);
+
+	start = get_timer(0);
+	for (ix = 0; ix < loops; ix++) {
+		crc_lib = crc32(0, buf, length);
+		WATCHDOG_RESET();
+	}
+	hash_bench_report("crc32 lib", length, loops, get_timer(start));
+
+	start = get_timer(0);
+	for (ix = 0; ix < loops; ix++) {
+		crc_slice = crc32_slice8(0, buf, length);
+		WATCHDOG_RESET();
+	}
+	hash_bench_report("crc32 slice-8", length, loops, get_timer(start));
+
+#ifdef CONFIG_SHA1
+	start = get_timer(0);
+	for (ix = 0; ix < loops; ix++) {
+		sha1_csum((unsigned char *)buf, length, sha1);
+		WATCHDOG_RESET();
+	}
+	hash_bench_report("sha1", length, loops, get_timer(start));
+#endif
+#ifdef CONFIG_MD5
+	start = get_timer(0);
+	for (ix = 0; ix < loops; ix++) {
+		md5((unsigned char *)buf, length, md5_sum);
+		WATCHDOG_RESET();
+	}
+	hash_bench_report("md5", length, loops, get_timer(start));
+#endif
+
+	if (crc_lib != crc_slice) {
+		printf("CRC mismatch: 0x%08x 0x%08x\n", crc_lib, crc_slice);
+		return 1;
+	}
+	return 0;
+}
+
+U_BOOT_CMD(
+	hashbench, 4, 0, do_hash_bench,
+	"benchmark the image hash implementations",
+	"address length [loops]\n"
+	"    - hash 'length' bytes at 'address' 'loops' times with each\n"
+	"      crc32, sha1 and md5 implementation, report the time and MB/s."
+);
+#endif /* CONFIG_CMD_HASH_BENCH */
@@ -2,6 +2,11 @@
 #include <watchdog.h>
 #include <command.h>
 #include <boot/customer.h>
+#include <malloc.h>
+
+#include "logif_util.h"
+
+DECLARE_GLOBAL_DATA_PTR;
 
 #define dump_buf(buf, len) do{\
 	int i;\
@@ -25,76 +30,339 @@
 #define START_FRAME_LEN	5
 #define MAX_BUFF_SIZE		1024
 
+/*
+ * Protocol version 2, negotiated by XVER. Old PC tools never send XVER
+ * and keep using XHEAD/XCMD, old targets drop XVER so a new PC tool
+ * times out and falls back to version 1.
+ *
+ * XVER  PC -> board: XVER ver crc16(2)
+ *       board -> PC: XVER ver window crc16(2)
+ * XDATA PC -> board: XDATA seq len(2) addr(4) crc16(2) payload crc16(2)
+ *       board -> PC: ACK seq, or NAK seq on payload error/timeout or
+ *                    an addr range outside RAM or over U-Boot
+ *
+ * The head crc16 covers XDATA..addr, the payload is written straight to
+ * "addr". The PC may have "window" XDATA frames in flight and resends
+ * only the NAKed (or timed out) sequence numbers.
+ *
+ * After the XCMD "dlstream emmc <address> <length>" "addr" is the byte
+ * offset in that eMMC range instead, the frames are written to eMMC
+ * while the next ones are received, until "dlstream close". Frames have
+ * to come in order there: one ahead of the data written so far is NAKed,
+ * one already written is ACKed again.
+ */
+#define	XVER	0xEF
+#define	XDATA	0xDA
+
+#define DOWNLOAD_VERSION	2
+#ifndef CONFIG_DOWNLOAD_WINDOW
+#define CONFIG_DOWNLOAD_WINDOW	8
+#endif
+
+#define XVER_FRAME_LEN		4
+#define XDATA_HEAD_LEN		10
+#define FRAME_TIMEOUT		100     /* ms, max gap between two bytes */
+#define XDATA_CRC_STEP		64      /* payload bytes per crc update */
+#define XDATA_STACK_GUARD	(32 * 1024)	/* stack below sp kept free */
+#define XDATA_MAX_LEN		0xFFFF
+
+#ifndef CONFIG_DOWNLOAD_STREAM_CHUNK
+#define CONFIG_DOWNLOAD_STREAM_CHUNK	0x100000	/* two of them in RAM */
+#endif
+
 static char recv_buf[MAX_BUFF_SIZE];
 
-static unsigned short crc16_table[256] = {
-	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7, 
-	0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef, 
-	0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6, 
-	0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de, 
-	0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485, 
-	0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d, 
-	0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4, 
-	0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc, 
-	0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823, 
-	0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b, 
-	0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12, 
-	0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a, 
-	0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41, 
-	0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49, 
-	0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70, 
-	0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78, 
-	0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f, 
-	0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067, 
-	0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e, 
-	0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256, 
-	0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d, 
-	0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405, 
-	0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c, 
-	0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634, 
-	0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab, 
-	0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3, 
-	0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a, 
-	0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92, 
-	0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9, 
-	0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1, 
-	0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8, 
-	0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0, 
-};
-
-static unsigned short calc_crc16(unsigned char *packet, unsigned long length)
+extern unsigned short crc16_ccitt(unsigned short crc,
+	const unsigned char *buf, unsigned int length);
+
+extern int download_rx_getc(void);
+extern void download_rx_putc(char c);
+extern void download_rx_service(void);
+
+static int recv_byte(void)
+{
+	return download_rx_getc();
+}
+
+static char recv_data(void)
+{
+	int ret = -1;
+
+	while(ret == -1)
+		ret = recv_byte();
+
+	return (char)ret;
+}
+
+static int recv_data_timeout(unsigned char *buf, unsigned int len)
 {
-	unsigned short crc16 = 0;
-	unsigned long i;
+	unsigned long start;
+
+	while(len > 0){
+		int c;
 
-	for (i = 0; i < length; i++){        
-		crc16 = ((crc16<<8)|packet[i])^crc16_table[(crc16>>8)&0xFF];
+		start = get_timer(0);
+		while((c = download_rx_getc()) == -1){
+			if(get_timer(start) > FRAME_TIMEOUT)
+				return -1;
+		}
+		*buf++ = (unsigned char)c;
+		len--;
 	}
 
-	for (i = 0; i < 2; i++){
-		crc16 = ((crc16<<8)|0)^crc16_table[(crc16>>8)&0xFF];
+	return 0;
+}
+
+/* throw away input until the line was idle for FRAME_TIMEOUT */
+static void drain_line(void)
+{
+	unsigned long start = get_timer(0);
+
+	while(get_timer(start) <= FRAME_TIMEOUT){
+		if(download_rx_getc() != -1)
+			start = get_timer(0);
 	}
+}
+
+static void send_frame(unsigned char *buf, int len)
+{
+	int i;
 
-	return crc16;
+	for(i=0;i<len;i++)
+		download_rx_putc(buf[i]);
 }
 
-static int recv_byte(void)
+static void download_xver(void)
 {
-	if(serial_tstc()){
-		return serial_getc();
+	unsigned char frame[XVER_FRAME_LEN + 1];
+	unsigned short cksum;
+
+	frame[0] = XVER;
+
+	/* RECV: version frame */
+	if(recv_data_timeout(frame + 1, XVER_FRAME_LEN - 1))
+		return;
+
+	cksum = crc16_ccitt(0, frame, 2);
+	if(cksum != ((frame[2] << 8) | frame[3])){
+		download_rx_putc(NAK);
+		return;
 	}
 
-	return -1;
+	/* SEND: version we both speak, and our window */
+	if(frame[1] > DOWNLOAD_VERSION)
+		frame[1] = DOWNLOAD_VERSION;
+	frame[2] = CONFIG_DOWNLOAD_WINDOW;
+	cksum = crc16_ccitt(0, frame, 3);
+	frame[3] = (unsigned char)(cksum >> 8);
+	frame[4] = (unsigned char)cksum;
+	send_frame(frame, XVER_FRAME_LEN + 1);
 }
 
-static char recv_data(void)
+/*
+ * The payload goes where the PC says: only into RAM, and not over
+ * U-Boot, that is from below our stack (heap and global data are above
+ * it) up to the end of the bss.
+ */
+static int xdata_addr_ok(unsigned long addr, unsigned int len)
 {
-	int ret = -1;
+	unsigned long ram_start = gd->bd->bi_dram[0].start;
+	unsigned long ram_end = ram_start + gd->bd->bi_dram[0].size;
+	unsigned long boot_sp;
 
-	while(ret == -1)
-		ret = recv_byte();
+	__asm__ __volatile__(
+		"mov    %0, sp\n"
+		:"=r"(boot_sp)
+		:
+		:"cc"
+		);
 
-	return (char)ret;
+	if(addr < ram_start || addr > ram_end || len > ram_end - addr)
+		return 0;
+	if(addr + len > boot_sp - XDATA_STACK_GUARD && addr <= _bss_end)
+		return 0;
+
+	return 1;
+}
+
+#ifdef CONFIG_CMD_MMC
+/* "dlstream emmc": XDATA payloads go to eMMC */
+static emmc_logic_t *xstream_emmc;
+static emmc_logic_stream_t *xstream;
+static unsigned long long xstream_pos;  /* bytes written to the stream */
+static unsigned char *xstream_frame;    /* payload of one XDATA frame */
+
+/* while a chunk goes to eMMC, keep the UART FIFO drained */
+static void xstream_poll(void *arg)
+{
+	download_rx_service();
+}
+
+/* return - 0: the frame is in the stream (now or before), -1: NAK it */
+static int xstream_put(unsigned long offset, unsigned char *data,
+	unsigned int len)
+{
+	unsigned int skip;
+
+	if(offset > xstream_pos)
+		return -1;
+	if(offset + len <= xstream_pos)
+		return 0;
+
+	skip = (unsigned int)(xstream_pos - offset);
+	if(emmc_logic_stream_write(xstream, data + skip, len - skip))
+		return -1;
+	xstream_pos += len - skip;
+	return 0;
+}
+
+static void xstream_end(void)
+{
+	free(xstream_frame);
+	emmc_logic_close(xstream_emmc);
+	xstream_frame = NULL;
+	xstream_emmc = NULL;
+	xstream = NULL;
+}
+
+int do_dlstream(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	unsigned long long address, length;
+	int ret;
+
+	if(argc == 2 && !strcmp(argv[1], "close")){
+		if(!xstream){
+			printf("no stream open\n");
+			return 1;
+		}
+		ret = emmc_logic_stream_close(xstream);
+		printf("dlstream: 0x%llx bytes written%s\n", xstream_pos,
+			ret ? ", write error" : "");
+		xstream_end();
+		return ret ? 1 : 0;
+	}
+
+	if(argc != 4 || strcmp(argv[1], "emmc")){
+		cmd_usage(cmdtp);
+		return 1;
+	}
+	if(xstream){
+		printf("stream already open\n");
+		return 1;
+	}
+
+	address = simple_strtoull(argv[2], NULL, 16);
+	length  = simple_strtoull(argv[3], NULL, 16);
+
+	xstream_emmc = emmc_logic_open(address, length);
+	if(!xstream_emmc)
+		return 1;
+
+	xstream_frame = malloc(XDATA_MAX_LEN);
+	if(xstream_frame)
+		xstream = emmc_logic_stream_open(xstream_emmc, 0,
+			CONFIG_DOWNLOAD_STREAM_CHUNK, xstream_poll, NULL);
+	if(!xstream){
+		xstream_end();
+		return 1;
+	}
+	xstream_pos = 0;
+	return 0;
+}
+
+U_BOOT_CMD(
+	dlstream, 4, 0, do_dlstream,
+	"write the XDATA frames of the download to eMMC",
+	"emmc <address> <length>\n"
+	"    - frames of this download go to eMMC from 'address' on\n"
+	"dlstream close\n"
+	"    - write what is left and go back to download to RAM"
+);
+#endif /* CONFIG_CMD_MMC */
+
+static void download_xdata(void)
+{
+	unsigned char head[XDATA_HEAD_LEN];
+	unsigned char reply[2];
+	unsigned char *addr, *data;
+	unsigned long dest;
+	unsigned int len, left, n;
+	unsigned short cksum;
+
+	head[0] = XDATA;
+
+	/* RECV: head, drop it silently if cut short, the PC resends on timeout */
+	if(recv_data_timeout(head + 1, XDATA_HEAD_LEN - 1))
+		return;
+
+	reply[0] = NAK;
+	reply[1] = head[1];
+
+	/*
+	 * Broken head: the payload must not reach the command dispatcher,
+	 * skip it until the PC stops sending, then nak the seq we got.
+	 */
+	cksum = crc16_ccitt(0, head, XDATA_HEAD_LEN - 2);
+	if(cksum != ((head[8] << 8) | head[9])){
+		drain_line();
+		send_frame(reply, 2);
+		return;
+	}
+
+	len  = (head[2] << 8) | head[3];
+	dest = ((unsigned long)head[4] << 24)
+		| (head[5] << 16) | (head[6] << 8) | head[7];
+
+#ifdef CONFIG_CMD_MMC
+	if(xstream)
+		data = xstream_frame;
+	else
+#endif
+	{
+		/* no place to put it: skip the payload as for a broken head */
+		if(!xdata_addr_ok(dest, len)){
+			drain_line();
+			send_frame(reply, 2);
+			return;
+		}
+		data = (unsigned char *)dest;
+	}
+
+	/* RECV: payload straight to ram, crc while receiving */
+	cksum = 0;
+	for(addr = data, left = len; left > 0; left -= n, addr += n){
+		n = (left > XDATA_CRC_STEP) ? XDATA_CRC_STEP : left;
+		if(recv_data_timeout(addr, n)){
+			send_frame(reply, 2);
+			return;
+		}
+		cksum = crc16_ccitt(cksum, addr, n);
+		download_rx_service();
+	}
+
+	if(recv_data_timeout(head, 2)){
+		send_frame(reply, 2);
+		return;
+	}
+
+	/*
+	 * SEND: ack or selective nak. On a bad payload the PC may still be
+	 * sending, let the line go idle first as for a broken head.
+	 */
+	if(cksum != ((head[0] << 8) | head[1])){
+		drain_line();
+		send_frame(reply, 2);
+		return;
+	}
+
+#ifdef CONFIG_CMD_MMC
+	if(xstream && xstream_put(dest, data, len)){
+		send_frame(reply, 2);
+		return;
+	}
+#endif
+	reply[0] = ACK;
+	send_frame(reply, 2);
 }
 
 void download_process(void)
@@ -121,14 +389,19 @@ retry:
 			}
 
 			/* crc check */
-			cksum = calc_crc16((unsigned char*)recv_buf,3);
+			cksum = crc16_ccitt(0, (unsigned char*)recv_buf, 3);
 			if(cksum == ((recv_buf[3] << 8) | recv_buf[4])){ 
 
 				/* init */
 				cmd_len = ((recv_buf[1] << 8) | recv_buf[2]) + 3;
 
-				/* SEND: ack */
-				send_buf[0] = ACK;
+				/* SEND: ack, nak if the cmd does not fit */
+				if(cmd_len > MAX_BUFF_SIZE){
+					cmd_len = 0;
+					send_buf[0] = NAK;
+				} else {
+					send_buf[0] = ACK;
+				}
 			} else {
 				/* init */
 				cmd_len = 0; 
@@ -136,8 +409,15 @@ retry:
 				/* SEND: nak */
 				send_buf[0] = NAK;			
 			}
-			serial_putc(send_buf[0]);
+			download_rx_putc(send_buf[0]);
 		} else if(XCMD == cr){
+			/* no good head before, do not know how much to read */
+			if(cmd_len < 3 || cmd_len > MAX_BUFF_SIZE){
+				drain_line();
+				download_rx_putc(NAK);
+				goto retry;
+			}
+
 			recv_buf[0] = (char)cr;
 
 			/* RECV: cmd data */
@@ -146,16 +426,16 @@ retry:
 			}
 
 			/* crc check */
-			cksum = calc_crc16((unsigned char*)recv_buf, cmd_len - 2);
+			cksum = crc16_ccitt(0, (unsigned char*)recv_buf, cmd_len - 2);
 			if(cksum == ((recv_buf[cmd_len-2] << 8) | recv_buf[cmd_len-1])){
 				/* SEND: ack wait result */
 				send_buf[0] = ACK;
-				serial_putc(send_buf[0]);
+				download_rx_putc(send_buf[0]);
 			} else {
 				memset(recv_buf, 0, sizeof(recv_buf));
 				/* SEND: nak */
 				send_buf[0] = NAK;
-				serial_putc(send_buf[0]);
+				download_rx_putc(send_buf[0]);
 				//dump_buf(recv_buf, cmd_len);
 
 				goto retry;
@@ -174,6 +454,11 @@ retry:
 				/* SEND: end flag */
 				serial_puts("[EOT](OK)\n");
 			}
+		} else if(XVER == cr){
+			download_xver();
+		} else if(XDATA == cr){
+			WATCHDOG_RESET();
+			download_xdata();
 		} else {
 			/* flush fifo */
 		}
@@ -0,0 +1,121 @@
+/******************************************************************************
+*    Copyright (c) 2009-2011 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * Receive ring of the download process. Each service drains everything
+ * the UART FIFO holds into the ring, so the FIFO does not overflow while
+ * the download process is busy on a frame (CRC, writing to ram, sending
+ * a reply). The download code services the ring between such steps and
+ * reads bytes from the ring only.
+ *
+ * Interrupts are not used by this u-boot, the ring is fed by polling.
+ */
+
+#include <common.h>
+#include <command.h>
+
+#ifndef CONFIG_DOWNLOAD_RX_RING
+#define CONFIG_DOWNLOAD_RX_RING		4096    /* MUST be power of 2 */
+#endif
+
+#define RX_RING_MASK	(CONFIG_DOWNLOAD_RX_RING - 1)
+
+static unsigned char rx_ring[CONFIG_DOWNLOAD_RX_RING];
+static unsigned int rx_head;            /* next byte to write */
+static unsigned int rx_tail;            /* next byte to read */
+
+static unsigned long rx_bytes;          /* bytes taken from the UART */
+static unsigned long rx_ring_overrun;   /* bytes dropped, ring full */
+static unsigned long rx_fifo_overrun;   /* UART FIFO overrun reports */
+static unsigned int rx_max_fill;        /* high water mark of the ring */
+
+/*****************************************************************************/
+/*
+ * Boards report (and clear) the UART overrun error flag here, return 1
+ * if the FIFO overflowed since the last call.
+ */
+int __download_rx_fifo_overrun(void)
+{
+	return 0;
+}
+int download_rx_fifo_overrun(void)
+	__attribute__((weak, alias("__download_rx_fifo_overrun")));
+/*****************************************************************************/
+
+void download_rx_service(void)
+{
+	unsigned int fill;
+
+	if (download_rx_fifo_overrun())
+		rx_fifo_overrun++;
+
+	while (serial_tstc()) {
+		unsigned char c = (unsigned char)serial_getc();
+
+		rx_bytes++;
+		if ((rx_head - rx_tail) >= CONFIG_DOWNLOAD_RX_RING) {
+			rx_ring_overrun++;
+			continue;
+		}
+		rx_ring[rx_head & RX_RING_MASK] = c;
+		rx_head++;
+	}
+
+	fill = rx_head - rx_tail;
+	if (fill > rx_max_fill)
+		rx_max_fill = fill;
+}
+/*****************************************************************************/
+/*
+ * return - the next received byte, -1 if there is none.
+ */
+int download_rx_getc(void)
+{
+	int c;
+
+	if (rx_head == rx_tail)
+		download_rx_service();
+
+	if (rx_head == rx_tail)
+		return -1;
+
+	c = rx_ring[rx_tail & RX_RING_MASK];
+	rx_tail++;
+	return c;
+}
+/*****************************************************************************/
+
+void download_rx_putc(char c)
+{
+	download_rx_service();
+	serial_putc(c);
+}
+/*****************************************************************************/
+
+int do_download_rx_stat(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	printf("rx bytes        : %lu\n", rx_bytes);
+	printf("ring overrun    : %lu\n", rx_ring_overrun);
+	printf("fifo overrun    : %lu\n", rx_fifo_overrun);
+	printf("ring high water : %u/%u\n", rx_max_fill,
+		CONFIG_DOWNLOAD_RX_RING);
+
+	if (argc > 1 && !strcmp(argv[1], "clear")) {
+		rx_bytes = 0;
+		rx_ring_overrun = 0;
+		rx_fifo_overrun = 0;
+		rx_max_fill = 0;
+	}
+	return 0;
+}
+
+U_BOOT_CMD(
+	dlrxstat, 2, 0, do_download_rx_stat,
+	"show download receive ring statistics",
+	"[clear]\n"
+	"    - show received bytes, overrun counters and ring high water,\n"
+	"      'clear' resets them after printing"
+);
@@ -13,9 +13,17 @@
 
 #include <emmc_logif.h>
 
+#include "logif_util.h"
+#include "fit_cache.h"
+
 #ifdef CONFIG_CMD_MMC
 /*****************************************************************************/
 
+/* compare unit of the differential write */
+#define EMMC_DIFF_CHUNK		0x10000
+
+/*****************************************************************************/
+
 emmc_logic_t *emmc_logic_open(unsigned long long address, unsigned long long length)
 {
 	emmc_logic_t *emmc_logic;
@@ -106,9 +114,12 @@ int emmc_logic_write
 		return -1;
 	}
 
+	fit_cache_note_write("emmc", emmc_logic->address + offset, length);
+
 	blk = (emmc_logic->address + offset) / emmc_logic->blocksize;
 	cnt = length / emmc_logic->blocksize;
 	ret = emmc_logic->mmc->block_dev.block_write(0, blk, cnt, buf);
+	fit_cache_note_done();
 
 	return (ret == cnt) ? 0 : ret;
 }
@@ -147,8 +158,460 @@ int emmc_logic_read
 	blk = (emmc_logic->address + offset) / emmc_logic->blocksize;
 	cnt = length / emmc_logic->blocksize;
 	ret = emmc_logic->mmc->block_dev.block_read(0, blk, cnt, buf);
+	if (ret != cnt)
+		return ret;
 
-	return (ret == cnt) ? 0 : ret;
+	fit_cache_note_read("emmc", emmc_logic->address + offset, buf, length);
+	return 0;
+}
+/*****************************************************************************/
+/*
+ * Scatter-gather access. The segments are one continuous range of the
+ * handle starting at "offset", neither offset nor segment lengths need
+ * to be block aligned. Unaligned head and tail blocks are done with
+ * read-modify-write, whole blocks go straight to/from the segment
+ * buffers, as few multi-block transfers as the segment layout allows.
+ * struct emmc_logic_sg is in logif_util.h.
+ */
+struct emmc_logic_sg_iter {
+	struct emmc_logic_sg *sg;
+	int count;
+	unsigned int pos;       /* offset in sg[0] */
+};
+/*****************************************************************************/
+
+static int emmc_logic_xfer(emmc_logic_t *emmc_logic, unsigned long blk,
+	unsigned long cnt, unsigned char *buf, int write)
+{
+	unsigned long ret;
+
+	if (write) {
+		fit_cache_note_write("emmc",
+			(unsigned long long)blk * emmc_logic->blocksize,
+			(unsigned long long)cnt * emmc_logic->blocksize);
+		ret = emmc_logic->mmc->block_dev.block_write(0, blk, cnt, buf);
+		fit_cache_note_done();
+	} else
+		ret = emmc_logic->mmc->block_dev.block_read(0, blk, cnt, buf);
+
+	return (ret == cnt) ? 0 : -1;
+}
+/*****************************************************************************/
+/*
+ * Copy "length" bytes between the segments and "buf", advance the iterator.
+ */
+static void emmc_logic_sg_copy(struct emmc_logic_sg_iter *iter,
+	unsigned char *buf, unsigned int length, int to_sg)
+{
+	while (length > 0 && iter->count > 0) {
+		unsigned int n = iter->sg->length - iter->pos;
+
+		if (n > length)
+			n = length;
+
+		if (to_sg)
+			memcpy(iter->sg->buf + iter->pos, buf, n);
+		else
+			memcpy(buf, iter->sg->buf + iter->pos, n);
+
+		buf       += n;
+		length    -= n;
+		iter->pos += n;
+		if (iter->pos == iter->sg->length) {
+			iter->sg++;
+			iter->count--;
+			iter->pos = 0;
+		}
+	}
+}
+/*****************************************************************************/
+
+static int emmc_logic_rw_sg(emmc_logic_t *emmc_logic, unsigned long long offset,
+	struct emmc_logic_sg *sg, int count, int write)
+{
+	struct emmc_logic_sg_iter iter;
+	unsigned long long total = 0;
+	unsigned int blocksize = (unsigned int)emmc_logic->blocksize;
+	unsigned char *bounce;
+	unsigned long blk;
+	unsigned int head;
+	int ix;
+
+	for (ix = 0; ix < count; ix++)
+		total += sg[ix].length;
+
+	if ((offset > emmc_logic->length)
+		|| (total > emmc_logic->length)
+		|| ((offset + total) > emmc_logic->length))
+	{
+		printf("Attempt to %s outside the flash handle area, "
+			"flash handle size: 0x%08llx, offset: 0x%08llx, "
+			"length: 0x%08llx\n", (write ? "write" : "read"),
+			emmc_logic->length, offset, total);
+		return -1;
+	}
+
+	if ((bounce = malloc(blocksize)) == NULL)
+	{
+		printf("no many memory.\n");
+		return -1;
+	}
+
+	iter.sg    = sg;
+	iter.count = count;
+	iter.pos   = 0;
+
+	blk  = (emmc_logic->address + offset) / blocksize;
+	head = (unsigned int)(offset & (blocksize - 1));
+
+	while (total > 0)
+	{
+		unsigned int n;
+		unsigned long cnt;
+
+		WATCHDOG_RESET();
+
+		/* partial block, or a block spanning two segments */
+		if (head || total < blocksize
+			|| (iter.sg->length - iter.pos) < blocksize)
+		{
+			n = blocksize - head;
+			if (n > total)
+				n = (unsigned int)total;
+
+			if ((!write || n < blocksize)
+				&& emmc_logic_xfer(emmc_logic, blk, 1, bounce, 0))
+				goto fail;
+			emmc_logic_sg_copy(&iter, bounce + head, n, !write);
+			if (write && emmc_logic_xfer(emmc_logic, blk, 1, bounce, 1))
+				goto fail;
+
+			blk++;
+			total -= n;
+			head   = 0;
+			continue;
+		}
+
+		/* whole blocks straight from/to this segment */
+		cnt = (iter.sg->length - iter.pos) / blocksize;
+		if ((unsigned long long)cnt * blocksize > total)
+			cnt = (unsigned long)(total / blocksize);
+		n = cnt * blocksize;
+
+		if (emmc_logic_xfer(emmc_logic, blk, cnt,
+			iter.sg->buf + iter.pos, write))
+			goto fail;
+
+		iter.pos += n;
+		if (iter.pos == iter.sg->length)
+		{
+			iter.sg++;
+			iter.count--;
+			iter.pos = 0;
+		}
+		blk   += cnt;
+		total -= n;
+	}
+
+	free(bounce);
+	return 0;
+
+fail:
+	printf("eMMC %s block 0x%08lx failed\n",
+		(write ? "write" : "read"), blk);
+	free(bounce);
+	return -1;
+}
+/*****************************************************************************/
+
+int emmc_logic_writev
+(
+ emmc_logic_t *emmc_logic,
+ unsigned long long offset,    /* any byte offset */
+ struct emmc_logic_sg *sg,
+ int count
+ )
+{
+	return emmc_logic_rw_sg(emmc_logic, offset, sg, count, 1);
+}
+/*****************************************************************************/
+
+int emmc_logic_readv
+(
+ emmc_logic_t *emmc_logic,
+ unsigned long long offset,    /* any byte offset */
+ struct emmc_logic_sg *sg,
+ int count
+ )
+{
+	return emmc_logic_rw_sg(emmc_logic, offset, sg, count, 0);
+}
+/*****************************************************************************/
+/*
+ * Double-buffered streaming writer. The producer (a download path) fills
+ * one chunk buffer while the other one is written to eMMC. The mmc layer
+ * is synchronous, so the pending chunk is written in slices and "poll"
+ * is called between slices to let the producer keep receiving into the
+ * other buffer. Only two chunks of RAM are needed for any image size.
+ */
+struct emmc_logic_stream {
+	emmc_logic_t *emmc_logic;
+	unsigned long long offset;   /* handle offset of the next chunk */
+	unsigned int chunk;          /* chunk size, block aligned */
+	unsigned char *buf[2];
+	int cur;                     /* index of the buffer being filled */
+	unsigned int fill;           /* bytes in the buffer being filled */
+	int busy;                    /* the other buffer is being written */
+	int error;
+	void (*poll)(void *arg);
+	void *arg;
+};
+
+/* blocks written between two calls of the producer poll function */
+#define EMMC_STREAM_SLICE_BLOCKS	16
+/*****************************************************************************/
+
+emmc_logic_stream_t *emmc_logic_stream_open
+(
+ emmc_logic_t *emmc_logic,
+ unsigned long long offset,    /* should be alignment with emmc block size */
+ unsigned int chunk,           /* should be alignment with emmc block size */
+ void (*poll)(void *arg),      /* may be NULL */
+ void *arg
+ )
+{
+	emmc_logic_stream_t *stream;
+
+	if ((offset & (emmc_logic->blocksize - 1)) || !chunk
+		|| (chunk & (emmc_logic->blocksize - 1)))
+	{
+		printf("Attempt to open non block aligned stream, "
+			"emmc block size: 0x%08llx, offset: 0x%08llx, chunk: 0x%08x\n",
+			emmc_logic->blocksize, offset, chunk);
+		return NULL;
+	}
+
+	if ((stream = malloc(sizeof(emmc_logic_stream_t))) == NULL)
+	{
+		printf("no many memory.\n");
+		return NULL;
+	}
+	memset(stream, 0, sizeof(emmc_logic_stream_t));
+
+	stream->buf[0] = malloc(chunk);
+	stream->buf[1] = malloc(chunk);
+	if (!stream->buf[0] || !stream->buf[1])
+	{
+		printf("no many memory.\n");
+		free(stream->buf[0]);
+		free(stream->buf[1]);
+		free(stream);
+		return NULL;
+	}
+
+	stream->emmc_logic = emmc_logic;
+	stream->offset     = offset;
+	stream->chunk      = chunk;
+	stream->poll       = poll;
+	stream->arg        = arg;
+
+	return stream;
+}
+/*****************************************************************************/
+/*
+ * Write the buffer being filled ("length" bytes, block aligned), and
+ * switch the producer to the other buffer.
+ */
+static int emmc_logic_stream_flush(emmc_logic_stream_t *stream,
+	unsigned int length)
+{
+	emmc_logic_t *emmc_logic = stream->emmc_logic;
+	unsigned char *buf = stream->buf[stream->cur];
+	unsigned long blk, cnt;
+
+	if ((stream->offset > emmc_logic->length)
+		|| ((stream->offset + length) > emmc_logic->length))
+	{
+		printf("Attempt to write outside the flash handle area, "
+			"flash handle size: 0x%08llx, offset: 0x%08llx, "
+			"length: 0x%08x\n",
+			emmc_logic->length, stream->offset, length);
+		stream->error = -1;
+		return -1;
+	}
+
+	stream->cur ^= 1;
+	stream->fill = 0;
+	stream->busy = 1;
+
+	blk = (emmc_logic->address + stream->offset) / emmc_logic->blocksize;
+	cnt = length / emmc_logic->blocksize;
+	stream->offset += length;
+
+	while (cnt > 0)
+	{
+		unsigned long n = (cnt > EMMC_STREAM_SLICE_BLOCKS)
+			? EMMC_STREAM_SLICE_BLOCKS : cnt;
+
+		WATCHDOG_RESET();
+
+		if (emmc_logic_xfer(emmc_logic, blk, n, buf, 1))
+		{
+			printf("eMMC write block 0x%08lx failed\n", blk);
+			stream->error = -1;
+			break;
+		}
+		blk += n;
+		cnt -= n;
+		buf += n * emmc_logic->blocksize;
+
+		if (stream->poll)
+			stream->poll(stream->arg);
+	}
+
+	stream->busy = 0;
+	return stream->error;
+}
+/*****************************************************************************/
+/*
+ * Get the free space of the buffer being filled, the producer receives
+ * into "*buf" directly and then calls emmc_logic_stream_commit().
+ */
+unsigned int emmc_logic_stream_space(emmc_logic_stream_t *stream,
+	unsigned char **buf)
+{
+	*buf = stream->buf[stream->cur] + stream->fill;
+	return stream->chunk - stream->fill;
+}
+/*****************************************************************************/
+
+int emmc_logic_stream_commit(emmc_logic_stream_t *stream, unsigned int length)
+{
+	if (length > stream->chunk - stream->fill)
+		return -1;
+
+	stream->fill += length;
+
+	/* called from the poll function, the outer flush picks it up */
+	if (stream->busy)
+		return stream->error;
+
+	while (!stream->error && stream->fill == stream->chunk)
+		emmc_logic_stream_flush(stream, stream->chunk);
+
+	return stream->error;
+}
+/*****************************************************************************/
+
+int emmc_logic_stream_write(emmc_logic_stream_t *stream,
+	const unsigned char *data, unsigned int length)
+{
+	while (length > 0 && !stream->error)
+	{
+		unsigned char *buf;
+		unsigned int n = emmc_logic_stream_space(stream, &buf);
+
+		if (n > length)
+			n = length;
+
+		memcpy(buf, data, n);
+		data   += n;
+		length -= n;
+		emmc_logic_stream_commit(stream, n);
+	}
+	return stream->error;
+}
+/*****************************************************************************/
+/*
+ * Write the data left in the buffer, the unaligned tail is done with
+ * read-modify-write. Return the stream error status.
+ */
+int emmc_logic_stream_close(emmc_logic_stream_t *stream)
+{
+	int ret = stream->error;
+
+	if (!ret && stream->fill)
+	{
+		struct emmc_logic_sg sg;
+
+		sg.buf    = stream->buf[stream->cur];
+		sg.length = stream->fill;
+		ret = emmc_logic_writev(stream->emmc_logic, stream->offset,
+			&sg, 1);
+	}
+
+	free(stream->buf[0]);
+	free(stream->buf[1]);
+	free(stream);
+
+	return ret;
+}
+/*****************************************************************************/
+/*
+ * Differential write, only the chunks which changed are written.
+ * Each chunk is read back and compared with the new data first.
+ */
+int emmc_logic_write_diff
+(
+ emmc_logic_t *emmc_logic,
+ unsigned long long offset,    /* should be alignment with emmc block size */
+ unsigned int length,          /* should be alignment with emmc block size */
+ unsigned char *buf
+ )
+{
+	unsigned int chunk, nr_chunks = 0, nr_skip = 0;
+	unsigned char *readbuf;
+	int ret = 0;
+
+	/* Reject write, which are not block aligned */
+	if ((offset & (emmc_logic->blocksize - 1)) || (length & (emmc_logic->blocksize - 1)))
+	{
+		printf("Attempt to write non block aligned data, "
+			"emmc block size: 0x%08llx, offset: 0x%08llx, length: 0x%08x\n",
+			emmc_logic->blocksize, offset, length);
+		return -1;
+	}
+
+	if ((offset > emmc_logic->length)
+		|| (length > emmc_logic->length)
+		|| ((offset + length) > emmc_logic->length))
+	{
+		printf("Attempt to write outside the flash handle area, "
+			"flash handle size: 0x%08llx, offset: 0x%08llx, "
+			"length: 0x%08x\n",
+			emmc_logic->length, offset, length);
+		return -1;
+	}
+
+	if ((readbuf = malloc(EMMC_DIFF_CHUNK)) == NULL)
+	{
+		printf("no many memory.\n");
+		return -1;
+	}
+
+	for (; length > 0; length -= chunk, offset += chunk, buf += chunk)
+	{
+		WATCHDOG_RESET();
+
+		chunk = (length > EMMC_DIFF_CHUNK) ? EMMC_DIFF_CHUNK : length;
+		nr_chunks++;
+
+		if (!emmc_logic_read(emmc_logic, offset, chunk, readbuf)
+			&& !memcmp(readbuf, buf, chunk))
+		{
+			nr_skip++;
+			continue;
+		}
+
+		ret = emmc_logic_write(emmc_logic, offset, chunk, buf);
+		if (ret)
+			break;
+	}
+	free(readbuf);
+
+	printf("Program %u chunks, %u unchanged chunks skipped\n",
+		nr_chunks, nr_skip);
+	return ret;
 }
 /*****************************************************************************/
 #endif /* CONFIG_CMD_MMC */
@@ -29,6 +29,7 @@
 #include <environment.h>
 #include <linux/stddef.h>
 #include <malloc.h>
+#include "bootstage.h"
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -49,6 +50,10 @@ extern env_t *env_ptr;
 extern int env_relocate_spec (unsigned int);
 extern uchar env_get_char_spec(int);
 
+extern void env_hash_build (void);
+extern void env_hash_invalidate (void);
+extern void env_compact (void);
+
 static uchar env_get_char_init (int index);
 
 /************************************************************************
@@ -142,11 +147,97 @@ uchar default_environment[] = {
 	"\0"
 };
 
+/*
+ * The CRC is only calculated again when setenv changed the env data
+ * since the last time (env_id moved on). 0 means unknown.
+ */
+static int env_crc_id;
+
+/*
+ * Copy of the env as it is in flash, to skip saving unchanged data and
+ * to let the media write only what changed. env_saved_id is the env_id
+ * the copy matches, 0 if the flash content is unknown.
+ */
+static env_t *env_saved;
+static int env_saved_id;
+
 void env_crc_update (void)
 {
+	if (env_crc_id && env_crc_id == get_env_id())
+		return;
+
+	/* never save the entries setenv only marked deleted */
+	env_compact();
 	env_ptr->crc = crc32(0, env_ptr->data, ENV_SIZE);
+	env_crc_id = get_env_id();
 }
 
+/* the env in RAM was just read from or written to flash */
+void env_mark_saved (void)
+{
+	if (!env_saved)
+		env_saved = (env_t *)malloc(CONFIG_ENV_SIZE);
+	if (!env_saved) {
+		env_saved_id = 0;
+		return;
+	}
+	memcpy(env_saved, env_ptr, CONFIG_ENV_SIZE);
+	env_saved_id = env_crc_id = get_env_id();
+}
+
+/* the env as it is in flash, NULL if unknown */
+env_t *env_get_saved (void)
+{
+	return env_saved_id ? env_saved : NULL;
+}
+
+/* 1 if the env in RAM differs from flash, call after env_crc_update() */
+int env_is_dirty (void)
+{
+	if (!env_saved_id)
+		return 1;
+	if (env_saved_id == get_env_id())
+		return 0;
+	/* setenv may have written the same values again */
+	if (memcmp(env_saved, env_ptr, CONFIG_ENV_SIZE))
+		return 1;
+	env_saved_id = get_env_id();
+	return 0;
+}
+
+#ifdef CONFIG_SYS_REDUNDAND_ENVIRONMENT
+/*
+ * Pick the copy to use from two redundant env copies: 1 or 2, 0 if
+ * neither has a good CRC. NULL stands for a copy that could not be
+ * read. "flags" is the generation of a copy, bumped on every save and
+ * wrapping from 255 to 0.
+ */
+int env_redund_select (env_t *env1, env_t *env2)
+{
+	int crc1_ok, crc2_ok;
+
+	crc1_ok = env1 && (crc32(0, env1->data, ENV_SIZE) == env1->crc);
+	crc2_ok = env2 && (crc32(0, env2->data, ENV_SIZE) == env2->crc);
+
+	if (!crc1_ok && !crc2_ok)
+		return 0;
+	if (crc1_ok && !crc2_ok)
+		return 1;
+	if (!crc1_ok && crc2_ok)
+		return 2;
+
+	/* both ok - check serial */
+	if (env1->flags == 255 && env2->flags == 0)
+		return 2;
+	if (env2->flags == 255 && env1->flags == 0)
+		return 1;
+	if (env2->flags > env1->flags)
+		return 2;
+	/* flags are equal - almost impossible */
+	return 1;
+}
+#endif /* CONFIG_SYS_REDUNDAND_ENVIRONMENT */
+
 static uchar env_get_char_init (int index)
 {
 	uchar c;
@@ -218,6 +309,9 @@ void set_default_env(void)
 	memset(env_ptr, 0, sizeof(env_t));
 	memcpy(env_ptr->data, default_environment,
 	       sizeof(default_environment));
+	env_hash_invalidate();
+	env_crc_id = 0;
+	env_saved_id = 0;
 #ifdef CONFIG_SYS_REDUNDAND_ENVIRONMENT
 	env_ptr->flags = 0xFF;
 #endif
@@ -274,7 +368,8 @@ void env_relocate (void)
 
 		rel = env_relocate_spec(CONFIG_ENV_ADDR);
 
-#ifdef CONFIG_ENV_BACKUP
+#if defined(CONFIG_ENV_BACKUP) && !defined(CONFIG_ENV_OFFSET_REDUND)
+		/* the redundant copies pick the good one on their own */
 		if (rel) {
 			printf("Read Env form %s addr(0x%08X) fail, "
 			       "try to read from Backup Env.\n",
@@ -295,9 +390,12 @@ void env_relocate (void)
 			      "using default environment\n\n",
 			      media_str);
 			set_default_env();
-		}
+		} else
+			env_mark_saved();
 	}
 	gd->env_addr = (ulong)&(env_ptr->data);
+	env_hash_build();
+	bootstage_mark("env_relocate");
 
 #ifdef CONFIG_AMIGAONEG3SE
 	disable_nvram();
@@ -321,6 +419,8 @@ int env_complete(char *var, int maxv, char *cmdv[], int bufsz, char *buf)
 			;
 
 		lval = (char *)env_get_addr(i);
+		if (*lval == '=')	/* deleted entry, see cmd_nvedit.c */
+			continue;
 		rval = strchr(lval, '=');
 		if (rval != NULL) {
 			vallen = rval - lval;
@@ -27,6 +27,7 @@
  */
 #include <common.h>
 #include <environment.h>
+#include <malloc.h>
 #include <mmc.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -34,6 +35,11 @@ DECLARE_GLOBAL_DATA_PTR;
 /* references to names in env_common.c */
 extern uchar default_environment[];
 
+#if defined(CONFIG_ENV_OFFSET_REDUND) && \
+    !defined(CONFIG_SYS_REDUNDAND_ENVIRONMENT)
+#error CONFIG_ENV_OFFSET_REDUND needs the flags of CONFIG_SYS_REDUNDAND_ENVIRONMENT
+#endif
+
 char *emmc_env_name_spec = "eMMC";
 extern env_t *env_ptr;
 
@@ -42,9 +48,21 @@ uchar emmc_env_get_char_spec(int index)
 	return *((uchar *)(gd->env_addr + index));
 }
 
-int emmc_saveenv(void)
+static int emmc_env_write(struct mmc *mmc, unsigned long offset,
+			  unsigned int sect, unsigned int count)
 {
 	int ret;
+
+	ret = mmc->block_dev.block_write(0, (offset >> 9) + sect,
+		 count, (uchar *)env_ptr + (sect << 9));
+
+	return (ret != count);
+}
+
+#ifdef CONFIG_ENV_OFFSET_REDUND
+int emmc_saveenv(void)
+{
+	unsigned long offset;
 	struct mmc *mmc = find_mmc_device(0);
 
 	if (!mmc) {
@@ -54,16 +72,113 @@ int emmc_saveenv(void)
 
 	mmc_init(mmc);
 
-	ret = mmc->block_dev.block_write(0, CONFIG_ENV_OFFSET >> 9,
-		 CONFIG_ENV_SIZE >> 9, env_ptr);
+	/* write over the older copy, the current one stays good */
+	env_ptr->flags++;
+	offset = (gd->env_valid == 1) ? CONFIG_ENV_OFFSET_REDUND
+				      : CONFIG_ENV_OFFSET;
 
-	if (ret != (CONFIG_ENV_SIZE >> 9))
+	if (emmc_env_write(mmc, offset, 0, CONFIG_ENV_SIZE >> 9))
 		return 1;
 
+	gd->env_valid = (gd->env_valid == 2 ? 1 : 2);
 	puts("done\n");
 	return 0;
 }
+#else /* ! CONFIG_ENV_OFFSET_REDUND */
+extern env_t *env_get_saved(void);
+
+int emmc_saveenv(void)
+{
+	unsigned int sect, start;
+	env_t *saved = env_get_saved();
+	struct mmc *mmc = find_mmc_device(0);
 
+	if (!mmc) {
+		puts("Environment SPI flash not initialized\n");
+		return 1;
+	}
+
+	mmc_init(mmc);
+
+	if (!saved) {
+		if (emmc_env_write(mmc, CONFIG_ENV_OFFSET, 0,
+				   CONFIG_ENV_SIZE >> 9))
+			return 1;
+		puts("done\n");
+		return 0;
+	}
+
+	/* the flash content is known, only write the sectors that changed */
+	for (sect = 0; sect < (CONFIG_ENV_SIZE >> 9); sect++) {
+		if (!memcmp((uchar *)env_ptr + (sect << 9),
+			    (uchar *)saved + (sect << 9), 512))
+			continue;
+
+		for (start = sect++; sect < (CONFIG_ENV_SIZE >> 9); sect++)
+			if (!memcmp((uchar *)env_ptr + (sect << 9),
+				    (uchar *)saved + (sect << 9), 512))
+				break;
+
+		if (emmc_env_write(mmc, CONFIG_ENV_OFFSET, start, sect - start))
+			return 1;
+	}
+
+	puts("done\n");
+	return 0;
+}
+#endif /* CONFIG_ENV_OFFSET_REDUND */
+
+#ifdef CONFIG_ENV_OFFSET_REDUND
+int emmc_env_relocate_spec(unsigned int offset)
+{
+	extern int env_redund_select(env_t *env1, env_t *env2);
+	int read1_ok, read2_ok, valid;
+	env_t *tmp_env1, *tmp_env2;
+	struct mmc *mmc = find_mmc_device(0);
+
+	if (!mmc)
+		return 1;
+
+	mmc_init(mmc);
+
+	tmp_env1 = (env_t *)malloc(2 * CONFIG_ENV_SIZE);
+	if (!tmp_env1) {
+		puts("Can't allocate buffers for environment\n");
+		return 1;
+	}
+	tmp_env2 = (env_t *)((uchar *)tmp_env1 + CONFIG_ENV_SIZE);
+
+	/* back to back copies come in with one read */
+	if (CONFIG_ENV_OFFSET_REDUND == CONFIG_ENV_OFFSET + CONFIG_ENV_SIZE) {
+		read1_ok = read2_ok = (mmc->block_dev.block_read(0,
+			CONFIG_ENV_OFFSET >> 9, (2 * CONFIG_ENV_SIZE) >> 9,
+			tmp_env1) == ((2 * CONFIG_ENV_SIZE) >> 9));
+	} else {
+		read1_ok = (mmc->block_dev.block_read(0,
+			CONFIG_ENV_OFFSET >> 9, CONFIG_ENV_SIZE >> 9,
+			tmp_env1) == (CONFIG_ENV_SIZE >> 9));
+		read2_ok = (mmc->block_dev.block_read(0,
+			CONFIG_ENV_OFFSET_REDUND >> 9, CONFIG_ENV_SIZE >> 9,
+			tmp_env2) == (CONFIG_ENV_SIZE >> 9));
+	}
+
+	/* flush cache after read */
+	flush_cache((ulong)tmp_env1, 2 * CONFIG_ENV_SIZE); /* FIXME */
+
+	valid = env_redund_select(read1_ok ? tmp_env1 : NULL,
+				  read2_ok ? tmp_env2 : NULL);
+	if (valid)
+		memcpy(env_ptr, (valid == 1) ? tmp_env1 : tmp_env2,
+		       CONFIG_ENV_SIZE);
+	free(tmp_env1);
+
+	if (!valid)
+		return 1;
+
+	gd->env_valid = valid;
+	return 0;
+}
+#else /* ! CONFIG_ENV_OFFSET_REDUND */
 int emmc_env_relocate_spec(unsigned int offset)
 {
 	int ret;
@@ -94,6 +209,7 @@ error:
 
 	return 1;
 }
+#endif /* CONFIG_ENV_OFFSET_REDUND */
 
 int emmc_env_init(void)
 {
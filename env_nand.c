@@ -286,7 +286,8 @@ int readenv (size_t offset, u_char * buf)
 int nand_env_relocate_spec (unsigned int offset)
 {
 #if !defined(ENV_IS_EMBEDDED)
-	int crc1_ok = 0, crc2_ok = 0;
+	extern int env_redund_select (env_t *env1, env_t *env2);
+	int read1_ok, read2_ok, valid;
 	env_t *tmp_env1, *tmp_env2;
 
 	tmp_env1 = (env_t *) malloc(CONFIG_ENV_SIZE);
@@ -299,36 +300,22 @@ int nand_env_relocate_spec (unsigned int offset)
 		return 1;
 	}
 
-	if (readenv(offset, (u_char *) tmp_env1))
+	/* both copies are read, the newer good one is used as is */
+	read1_ok = !readenv(offset, (u_char *) tmp_env1);
+	if (!read1_ok)
 		puts("No Valid Environment Area Found\n");
-	if (readenv(CONFIG_ENV_OFFSET_REDUND, (u_char *) tmp_env2))
+	read2_ok = !readenv(CONFIG_ENV_OFFSET_REDUND, (u_char *) tmp_env2);
+	if (!read2_ok)
 		puts("No Valid Reundant Environment Area Found\n");
 
-	crc1_ok = (crc32(0, tmp_env1->data, ENV_SIZE) == tmp_env1->crc);
-	crc2_ok = (crc32(0, tmp_env2->data, ENV_SIZE) == tmp_env2->crc);
-
-	if(!crc1_ok && !crc2_ok) {
+	valid = env_redund_select(read1_ok ? tmp_env1 : NULL,
+				  read2_ok ? tmp_env2 : NULL);
+	if (!valid) {
 		free(tmp_env1);
 		free(tmp_env2);
 		return 1;
-	} else if(crc1_ok && !crc2_ok)
-		gd->env_valid = 1;
-	else if(!crc1_ok && crc2_ok)
-		gd->env_valid = 2;
-	else {
-		/* both ok - check serial */
-		if(tmp_env1->flags == 255 && tmp_env2->flags == 0)
-			gd->env_valid = 2;
-		else if(tmp_env2->flags == 255 && tmp_env1->flags == 0)
-			gd->env_valid = 1;
-		else if(tmp_env1->flags > tmp_env2->flags)
-			gd->env_valid = 1;
-		else if(tmp_env2->flags > tmp_env1->flags)
-			gd->env_valid = 2;
-		else /* flags are equal - almost impossible */
-			gd->env_valid = 1;
-
 	}
+	gd->env_valid = valid;
 
 	free(env_ptr);
 	if(gd->env_valid == 1) {
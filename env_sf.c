@@ -44,6 +44,29 @@
 # define CONFIG_ENV_SPI_MODE	SPI_MODE_3
 #endif
 
+/*
+ * With CONFIG_ENV_OFFSET_REDUND the two copies are written in turn, each
+ * copy must start on its own erase sector.
+ */
+#ifdef CONFIG_ENV_OFFSET_REDUND
+#ifndef CONFIG_SYS_REDUNDAND_ENVIRONMENT
+#error CONFIG_ENV_OFFSET_REDUND needs the flags of CONFIG_SYS_REDUNDAND_ENVIRONMENT
+#endif
+#if (CONFIG_ENV_OFFSET % CONFIG_ENV_SECT_SIZE) || \
+    (CONFIG_ENV_OFFSET_REDUND % CONFIG_ENV_SECT_SIZE)
+#error CONFIG_ENV_OFFSET and CONFIG_ENV_OFFSET_REDUND must be sector aligned
+#endif
+
+/* the sectors erased for one copy */
+#define ENV_ERASE_SPAN	(((CONFIG_ENV_SIZE + CONFIG_ENV_SECT_SIZE - 1) \
+	/ CONFIG_ENV_SECT_SIZE) * CONFIG_ENV_SECT_SIZE)
+
+#if (CONFIG_ENV_OFFSET_REDUND < CONFIG_ENV_OFFSET + ENV_ERASE_SPAN) && \
+    (CONFIG_ENV_OFFSET < CONFIG_ENV_OFFSET_REDUND + ENV_ERASE_SPAN)
+#error CONFIG_ENV_OFFSET and CONFIG_ENV_OFFSET_REDUND share an erase sector
+#endif
+#endif /* CONFIG_ENV_OFFSET_REDUND */
+
 DECLARE_GLOBAL_DATA_PTR;
 
 /* references to names in env_common.c */
@@ -59,7 +82,8 @@ uchar sf_env_get_char_spec(int index)
 	return *((uchar *)(gd->env_addr + index));
 }
 
-int sf_saveenv(void)
+/* write the env to the copy at "offset" */
+static int sf_env_write(u32 offset)
 {
 	u32 saved_size, saved_offset;
 	char *saved_buffer = NULL;
@@ -76,7 +100,7 @@ int sf_saveenv(void)
 	/* Is the sector larger than the env (i.e. embedded) */
 	if (CONFIG_ENV_SECT_SIZE > CONFIG_ENV_SIZE) {
 		saved_size = CONFIG_ENV_SECT_SIZE - CONFIG_ENV_SIZE;
-		saved_offset = CONFIG_ENV_OFFSET + CONFIG_ENV_SIZE;
+		saved_offset = offset + CONFIG_ENV_SIZE;
 		saved_buffer = malloc(saved_size);
 		if (!saved_buffer) {
 			ret = 1;
@@ -94,6 +118,15 @@ int sf_saveenv(void)
 	}
 
 	erase_length = (sector * CONFIG_ENV_SECT_SIZE);
+#ifdef CONFIG_ENV_OFFSET_REDUND
+	/* a bigger erase would take the other copy with it */
+	if (erase_length < spiflash_info->erasesize) {
+		printf("Erase block 0x%08x larger than CONFIG_ENV_SECT_SIZE,"
+			" not saved\n", spiflash_info->erasesize);
+		ret = 1;
+		goto done;
+	}
+#endif
 	if (erase_length < spiflash_info->erasesize)
 	{
 		printf("Warning: Erase size 0x%08x smaller than one "	\
@@ -102,14 +135,14 @@ int sf_saveenv(void)
 		erase_length = spiflash_info->erasesize;
 	}
 	printf("Erasing SPI flash, offset 0x%08x size %s ...",
-		CONFIG_ENV_OFFSET, ultohstr(erase_length));
-	ret = spi_flash_erase(env_flash, CONFIG_ENV_OFFSET, erase_length);
+		offset, ultohstr(erase_length));
+	ret = spi_flash_erase(env_flash, offset, erase_length);
 	if (ret)
 		goto done;
 
 	printf("done\nWriting to SPI flash, offset 0x%08x size %s ...",
-		CONFIG_ENV_OFFSET, ultohstr(CONFIG_ENV_SIZE));
-	ret = spi_flash_write(env_flash, CONFIG_ENV_OFFSET, CONFIG_ENV_SIZE, env_ptr);
+		offset, ultohstr(CONFIG_ENV_SIZE));
+	ret = spi_flash_write(env_flash, offset, CONFIG_ENV_SIZE, env_ptr);
 	if (ret)
 		goto done;
 
@@ -128,6 +161,68 @@ int sf_saveenv(void)
 	return ret;
 }
 
+#ifdef CONFIG_ENV_OFFSET_REDUND
+int sf_saveenv(void)
+{
+	int ret;
+
+	/* write over the older copy, the current one stays good */
+	env_ptr->flags++;
+	ret = sf_env_write((gd->env_valid == 1) ? CONFIG_ENV_OFFSET_REDUND
+						: CONFIG_ENV_OFFSET);
+	if (ret)
+		return ret;
+
+	gd->env_valid = (gd->env_valid == 2 ? 1 : 2);
+	return 0;
+}
+#else /* ! CONFIG_ENV_OFFSET_REDUND */
+int sf_saveenv(void)
+{
+	return sf_env_write(CONFIG_ENV_OFFSET);
+}
+#endif /* CONFIG_ENV_OFFSET_REDUND */
+
+#ifdef CONFIG_ENV_OFFSET_REDUND
+/*
+ * Read both copies and use the newer good one as is.
+ * Return 0 if done, 1 if no copy is good, -1 if neither could be read.
+ */
+static int sf_env_read_redund(void)
+{
+	extern int env_redund_select(env_t *env1, env_t *env2);
+	int read1_ok, read2_ok, valid;
+	env_t *tmp_env1, *tmp_env2;
+
+	tmp_env1 = (env_t *)malloc(2 * CONFIG_ENV_SIZE);
+	if (!tmp_env1) {
+		puts("Can't allocate buffers for environment\n");
+		return 1;
+	}
+	tmp_env2 = (env_t *)((uchar *)tmp_env1 + CONFIG_ENV_SIZE);
+
+	read1_ok = !spi_flash_read(env_flash, CONFIG_ENV_OFFSET,
+		CONFIG_ENV_SIZE, tmp_env1);
+	read2_ok = !spi_flash_read(env_flash, CONFIG_ENV_OFFSET_REDUND,
+		CONFIG_ENV_SIZE, tmp_env2);
+
+	valid = env_redund_select(read1_ok ? tmp_env1 : NULL,
+				  read2_ok ? tmp_env2 : NULL);
+	if (valid)
+		memcpy(env_ptr, (valid == 1) ? tmp_env1 : tmp_env2,
+		       CONFIG_ENV_SIZE);
+	free(tmp_env1);
+
+	if (!read1_ok && !read2_ok)
+		return -1;
+	if (!valid)
+		return 1;
+
+	gd->env_valid = valid;
+	return 0;
+}
+#endif /* CONFIG_ENV_OFFSET_REDUND */
+
 int sf_env_relocate_spec(unsigned int offset)
 {
 	int ret;
@@ -137,6 +232,13 @@ int sf_env_relocate_spec(unsigned int offset)
 	if (!env_flash)
 		goto err_probe;
 
+#ifdef CONFIG_ENV_OFFSET_REDUND
+	ret = sf_env_read_redund();
+	if (ret < 0)
+		goto err_read;
+	if (ret)
+		goto err_crc;
+#else /* ! CONFIG_ENV_OFFSET_REDUND */
 	ret = spi_flash_read(env_flash, CONFIG_ENV_OFFSET, CONFIG_ENV_SIZE, env_ptr);
 	if (ret)
 		goto err_read;
@@ -145,6 +247,7 @@ int sf_env_relocate_spec(unsigned int offset)
 		goto err_crc;
 
 	gd->env_valid = 1;
+#endif /* CONFIG_ENV_OFFSET_REDUND */
 
 	return 0;
 
@@ -0,0 +1,607 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * Verify-once cache for FIT images. Once all hashes of a component image
+ * loaded from flash check out, fit_image_check_hashes() records
+ *
+ *   media:flash:length:generation:hash:crc0,...,crc7
+ *
+ * in the "fitcache" variable: where the data is in flash, the flash
+ * generation, the expected hash of the FIT and the CRC of each eighth of
+ * the data, and saves the environment, which is CRC protected (and
+ * redundant). That is once after an update: on the next boots the same
+ * image from the same place is taken as verified while the generation
+ * has not moved. Images hashed with crc32 only are not cached, checking
+ * the cache would cost as much as their hash.
+ *
+ * The environment is only saved when it had no unsaved changes before,
+ * a setenv of the boot script is not made permanent behind its back. With
+ * unsaved changes the cache and the generation are only updated in RAM,
+ * a "saveenv" keeps them.
+ *
+ * Where data in RAM came from is noted by the nand/emmc/spiflash logic
+ * reads, with the CRC of each 64KiB so RAM changed since is not taken
+ * for the flash. Their writes and erases move the generation ("fitgen")
+ * when they touch a cached range, it is saved when the write is done.
+ *
+ * The "nand", "mmc write" and "sf" commands tell of their writes and
+ * erases too. Not seen are the writes from outside U-Boot (Linux), to the
+ * eMMC boot partitions, of the nand/mmc devices other than the ones the
+ * logic interfaces use (all devices of a media count as one), and by
+ * UBI, yaffs or fat. "fitverify" sets how far the cache is trusted:
+ *   full   - always hash all the data, the cache is not used
+ *   cache  - skip the hashes of a cached image
+ *   sample - (default) skip them when two random eighths of the data
+ *            still have their CRC
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc.h>
+#include <image.h>
+#include <libfdt.h>
+
+#ifndef CONFIG_FIT_CACHE_ENTRIES
+#define CONFIG_FIT_CACHE_ENTRIES	8
+#endif
+
+#ifndef CONFIG_FIT_CACHE_LOADS
+#define CONFIG_FIT_CACHE_LOADS		8	/* flash reads remembered */
+#endif
+
+#define FIT_CACHE_SEGMENTS		8
+#define FIT_CACHE_SAMPLES		2
+#define FIT_CACHE_MEDIA_LEN		8
+#define FIT_CACHE_HASH_LEN		(2 * FIT_MAX_HASH_LEN + 1)
+#define FIT_CACHE_CHUNK			0x10000	/* RAM checked in chunks */
+
+#if !defined(CONFIG_CMD_SAVEENV) || defined(CONFIG_ENV_IS_NOWHERE)
+#error "CONFIG_FIT_VERIFY_CACHE needs saveenv"
+#endif
+
+extern int env_save(void);
+extern int env_is_dirty(void);
+
+#ifdef CONFIG_CRC32_SLICE8
+extern uint32_t crc32_slice8(uint32_t, const unsigned char *, unsigned int);
+#define fit_cache_crc32		crc32_slice8
+#else
+#define fit_cache_crc32		crc32
+#endif
+
+/*
+ * RAM loaded from flash. Other commands (tftp, cp, an uncompress) may
+ * change the RAM later without telling, so the CRC of each chunk is
+ * taken when it is read and checked again before the record is used.
+ */
+struct fit_cache_load {
+	const char *media;		/* NULL: unused */
+	unsigned long long flash;
+	ulong ram;
+	ulong length;
+	uint32_t *crc;			/* of each FIT_CACHE_CHUNK */
+	ulong crcs;			/* room at crc */
+};
+
+struct fit_cache_entry {
+	char media[FIT_CACHE_MEDIA_LEN];
+	unsigned long long flash;
+	ulong length;
+	ulong gen;
+	char hash[FIT_CACHE_HASH_LEN];
+	uint32_t crc[FIT_CACHE_SEGMENTS];
+};
+
+static struct fit_cache_load fit_cache_loads[CONFIG_FIT_CACHE_LOADS];
+static int fit_cache_next_load;
+
+/*
+ * "fitgen" was moved on: 1 it is saved when the write is done, -1 the
+ * environment had unsaved changes, it is kept in RAM only
+ */
+static int fit_cache_gen_dirty;
+
+/*****************************************************************************/
+/*
+ * Saves the environment after a change of the cache, "clean" tells if
+ * it had no unsaved changes before. If it had, they are not ours to
+ * save, the cache stays changed in RAM only.
+ */
+static int fit_cache_save(int clean)
+{
+	if (!clean) {
+		printf("fitcache: environment has unsaved changes,"
+			" run saveenv to keep fitgen/fitcache\n");
+		return 0;
+	}
+	if (env_save()) {
+		printf("fitcache: saving the environment failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+/*****************************************************************************/
+
+static void fit_cache_drop(struct fit_cache_load *ld)
+{
+	ld->media = NULL;
+	ld->length = 0;
+}
+
+static void fit_cache_forget_ram(ulong ram, ulong length,
+				 struct fit_cache_load *keep)
+{
+	struct fit_cache_load *ld;
+
+	for (ld = fit_cache_loads;
+	     ld < fit_cache_loads + CONFIG_FIT_CACHE_LOADS; ld++) {
+		if (ld != keep && ld->media && ram < ld->ram + ld->length
+		    && ld->ram < ram + length)
+			fit_cache_drop(ld);
+	}
+}
+
+/* add "length" bytes at "buf" to the end of the record */
+static int fit_cache_append(struct fit_cache_load *ld, const uchar *buf,
+			    ulong length)
+{
+	ulong ix, off, len;
+	uint32_t *crc;
+
+	ix = (ld->length + length + FIT_CACHE_CHUNK - 1) / FIT_CACHE_CHUNK;
+	if (ix > ld->crcs) {
+		crc = realloc(ld->crc, ix * 2 * sizeof(*crc));
+		if (!crc)
+			return -1;
+		ld->crc = crc;
+		ld->crcs = ix * 2;
+	}
+
+	while (length) {
+		ix  = ld->length / FIT_CACHE_CHUNK;
+		off = ld->length % FIT_CACHE_CHUNK;
+		len = FIT_CACHE_CHUNK - off;
+		if (len > length)
+			len = length;
+		ld->crc[ix] = fit_cache_crc32(off ? ld->crc[ix] : 0, buf, len);
+		ld->length += len;
+		buf += len;
+		length -= len;
+	}
+	return 0;
+}
+
+/* "length" bytes at "flash" were read to "buf" */
+void fit_cache_note_read(const char *media, unsigned long long flash,
+			 void *buf, unsigned int length)
+{
+	struct fit_cache_load *ld;
+	ulong ram = (ulong)buf;
+
+	/* the next piece of an earlier read */
+	for (ld = fit_cache_loads;
+	     ld < fit_cache_loads + CONFIG_FIT_CACHE_LOADS; ld++) {
+		if (ld->media && !strcmp(ld->media, media)
+		    && ld->ram + ld->length == ram
+		    && ld->flash + ld->length == flash) {
+			fit_cache_forget_ram(ram, length, ld);
+			if (fit_cache_append(ld, buf, length))
+				fit_cache_drop(ld);
+			return;
+		}
+	}
+
+	fit_cache_forget_ram(ram, length, NULL);
+	for (ld = fit_cache_loads;
+	     ld < fit_cache_loads + CONFIG_FIT_CACHE_LOADS; ld++) {
+		if (!ld->media)
+			break;
+	}
+	if (ld == fit_cache_loads + CONFIG_FIT_CACHE_LOADS) {
+		ld = fit_cache_loads + fit_cache_next_load;
+		fit_cache_next_load = (fit_cache_next_load + 1)
+			% CONFIG_FIT_CACHE_LOADS;
+	}
+	ld->media  = media;
+	ld->flash  = flash;
+	ld->ram    = ram;
+	ld->length = 0;
+	if (fit_cache_append(ld, buf, length))
+		fit_cache_drop(ld);
+}
+
+/* the RAM of the chunks over "ram", "length" is what was read */
+static int fit_cache_unchanged(struct fit_cache_load *ld, ulong ram,
+			       ulong length)
+{
+	ulong ix, last, len;
+
+	ix = (ram - ld->ram) / FIT_CACHE_CHUNK;
+	last = (ram + length - 1 - ld->ram) / FIT_CACHE_CHUNK;
+	for (; ix <= last; ix++) {
+		len = ld->length - ix * FIT_CACHE_CHUNK;
+		if (len > FIT_CACHE_CHUNK)
+			len = FIT_CACHE_CHUNK;
+		if (fit_cache_crc32(0, (const uchar *)ld->ram
+				+ ix * FIT_CACHE_CHUNK, len) != ld->crc[ix])
+			return 0;
+	}
+	return 1;
+}
+
+static int fit_cache_source(ulong ram, ulong length, const char **media,
+			    unsigned long long *flash)
+{
+	struct fit_cache_load *ld;
+
+	if (!length)
+		return -1;
+	for (ld = fit_cache_loads;
+	     ld < fit_cache_loads + CONFIG_FIT_CACHE_LOADS; ld++) {
+		if (ld->media && ram >= ld->ram
+		    && ram + length <= ld->ram + ld->length) {
+			if (!fit_cache_unchanged(ld, ram, length)) {
+				fit_cache_drop(ld);
+				return -1;
+			}
+			*media = ld->media;
+			*flash = ld->flash + (ram - ld->ram);
+			return 0;
+		}
+	}
+	return -1;
+}
+/*****************************************************************************/
+
+static ulong fit_cache_gen(void)
+{
+	char *s = getenv("fitgen");
+
+	return s ? simple_strtoul(s, NULL, 10) : 0;
+}
+
+/* one entry of "fitcache", returns the end of it or NULL */
+static const char *fit_cache_parse(const char *s, struct fit_cache_entry *e)
+{
+	char *end;
+	int ix;
+
+	for (ix = 0; s[ix] && s[ix] != ':'; ix++)
+		if (ix == FIT_CACHE_MEDIA_LEN - 1)
+			return NULL;
+	memcpy(e->media, s, ix);
+	e->media[ix] = '\0';
+	s += ix;
+	if (*s++ != ':')
+		return NULL;
+
+	e->flash = simple_strtoull(s, &end, 16);
+	if (*end++ != ':')
+		return NULL;
+	e->length = simple_strtoul(end, &end, 16);
+	if (*end++ != ':')
+		return NULL;
+	e->gen = simple_strtoul(end, &end, 10);
+	if (*end++ != ':')
+		return NULL;
+
+	s = end;
+	for (ix = 0; s[ix] && s[ix] != ':'; ix++)
+		if (ix == FIT_CACHE_HASH_LEN - 1)
+			return NULL;
+	memcpy(e->hash, s, ix);
+	e->hash[ix] = '\0';
+	s += ix;
+	if (*s++ != ':')
+		return NULL;
+
+	for (ix = 0; ix < FIT_CACHE_SEGMENTS; ix++) {
+		e->crc[ix] = simple_strtoul(s, &end, 16);
+		if (ix < FIT_CACHE_SEGMENTS - 1 && *end++ != ',')
+			return NULL;
+		s = end;
+	}
+	if (*s && *s != ' ')
+		return NULL;
+	return s;
+}
+
+static int fit_cache_read(struct fit_cache_entry *entry)
+{
+	const char *s = getenv("fitcache");
+	int count = 0;
+
+	while (s && count < CONFIG_FIT_CACHE_ENTRIES) {
+		while (*s == ' ')
+			s++;
+		if (!*s)
+			break;
+		s = fit_cache_parse(s, &entry[count]);
+		if (s)
+			count++;
+	}
+	return count;
+}
+
+static int fit_cache_write(struct fit_cache_entry *entry, int count)
+{
+	struct fit_cache_entry *e;
+	char *buf, *s;
+	int ix, ret;
+
+	if (!count)
+		return setenv("fitcache", NULL);
+
+	buf = malloc(count * (sizeof(*e) + FIT_CACHE_SEGMENTS * 9 + 64));
+	if (!buf)
+		return -1;
+	for (s = buf, e = entry; e < entry + count; e++) {
+		s += sprintf(s, "%s%s:%llx:%lx:%lu:%s:", (e == entry) ? "" : " ",
+			e->media, e->flash, e->length, e->gen, e->hash);
+		for (ix = 0; ix < FIT_CACHE_SEGMENTS; ix++)
+			s += sprintf(s, ix ? ",%x" : "%x", e->crc[ix]);
+	}
+	ret = setenv("fitcache", buf);
+	free(buf);
+	return ret;
+}
+/*****************************************************************************/
+
+/*
+ * hex of the value of the first hash node, the key of the image. -1 if
+ * there is none, or all hashes are crc32 and the cache is no faster.
+ */
+static int fit_cache_hash(const void *fit, int image_noffset, char *hex)
+{
+	uint8_t *value;
+	char *algo;
+	int noffset, ndepth;
+	int ix, len;
+	int keyed = 0, slow = 0;
+
+	for (ndepth = 0, noffset = fdt_next_node(fit, image_noffset, &ndepth);
+	     (noffset >= 0) && (ndepth > 0);
+	     noffset = fdt_next_node(fit, noffset, &ndepth)) {
+		if (ndepth != 1 || strncmp(fit_get_name(fit, noffset, NULL),
+				FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME)))
+			continue;
+		if (fit_image_hash_get_algo(fit, noffset, &algo))
+			return -1;
+		if (strcmp(algo, "crc32"))
+			slow = 1;
+		if (keyed)
+			continue;
+		if (fit_image_hash_get_value(fit, noffset, &value, &len)
+		    || len > FIT_MAX_HASH_LEN)
+			return -1;
+		for (ix = 0; ix < len; ix++)
+			sprintf(hex + 2 * ix, "%02x", value[ix]);
+		hex[2 * len] = '\0';
+		keyed = 1;
+	}
+	return (keyed && slow) ? 0 : -1;
+}
+
+static uint32_t fit_cache_segment(const void *data, ulong length, int ix)
+{
+	ulong seg = length / FIT_CACHE_SEGMENTS;
+	ulong len = (ix == FIT_CACHE_SEGMENTS - 1)
+		? length - ix * seg : seg;
+
+	return fit_cache_crc32(0, (const unsigned char *)data + ix * seg, len);
+}
+
+static int fit_cache_full(void)
+{
+	char *s = getenv("fitverify");
+
+	return s && !strcmp(s, "full");
+}
+
+/* the entry of this image from this place of the flash */
+static struct fit_cache_entry *fit_cache_find(struct fit_cache_entry *entry,
+	int count, const char *media, unsigned long long flash, ulong length,
+	const char *hash)
+{
+	struct fit_cache_entry *e;
+
+	for (e = entry; e < entry + count; e++) {
+		if (!strcmp(e->media, media) && e->flash == flash
+		    && e->length == length && !strcmp(e->hash, hash))
+			return e;
+	}
+	return NULL;
+}
+
+/*
+ * Returns 1 if the image was verified before and the flash has not been
+ * written since, 0 if its hashes have to be checked.
+ */
+int fit_cache_check(const void *fit, int image_noffset, const void *data,
+		    size_t size)
+{
+	struct fit_cache_entry entry[CONFIG_FIT_CACHE_ENTRIES];
+	struct fit_cache_entry *e;
+	char hash[FIT_CACHE_HASH_LEN];
+	unsigned long long flash;
+	const char *media;
+	char *policy;
+	ulong pick;
+	int count, ix, n;
+
+	if (fit_cache_full()
+	    || fit_cache_source((ulong)data, size, &media, &flash)
+	    || fit_cache_hash(fit, image_noffset, hash))
+		return 0;
+
+	count = fit_cache_read(entry);
+	e = fit_cache_find(entry, count, media, flash, size, hash);
+	if (!e || e->gen != fit_cache_gen())
+		return 0;
+
+	policy = getenv("fitverify");
+	if (policy && !strcmp(policy, "cache"))
+		return 1;
+
+	/* two different eighths */
+	pick = (ulong)get_ticks();
+	ix = pick % FIT_CACHE_SEGMENTS;
+	for (n = 0; n < FIT_CACHE_SAMPLES; n++) {
+		if (fit_cache_segment(data, size, ix) != e->crc[ix])
+			return 0;
+		ix = (ix + 1 + (pick >> 3) % (FIT_CACHE_SEGMENTS - 1))
+			% FIT_CACHE_SEGMENTS;
+	}
+	return 1;
+}
+
+/* all hashes of the image are good, remember it */
+void fit_cache_add(const void *fit, int image_noffset, const void *data,
+		   size_t size)
+{
+	struct fit_cache_entry entry[CONFIG_FIT_CACHE_ENTRIES];
+	struct fit_cache_entry *e;
+	char hash[FIT_CACHE_HASH_LEN];
+	unsigned long long flash;
+	const char *media;
+	ulong gen = fit_cache_gen();
+	int count, ix, clean;
+
+	if (fit_cache_full()
+	    || fit_cache_source((ulong)data, size, &media, &flash)
+	    || fit_cache_hash(fit, image_noffset, hash))
+		return;
+
+	count = fit_cache_read(entry);
+	e = fit_cache_find(entry, count, media, flash, size, hash);
+	if (e && e->gen == gen)
+		return;
+
+	/* drop what was cached for this place, and the oldest if full */
+	for (e = entry; e < entry + count; ) {
+		if (!strcmp(e->media, media) && flash < e->flash + e->length
+		    && e->flash < flash + size) {
+			memmove(e, e + 1, (entry + count - e - 1) * sizeof(*e));
+			count--;
+		} else {
+			e++;
+		}
+	}
+	if (count == CONFIG_FIT_CACHE_ENTRIES) {
+		memmove(entry, entry + 1, (count - 1) * sizeof(*entry));
+		count--;
+	}
+
+	e = &entry[count++];
+	strncpy(e->media, media, FIT_CACHE_MEDIA_LEN - 1);
+	e->media[FIT_CACHE_MEDIA_LEN - 1] = '\0';
+	e->flash = flash;
+	e->length = size;
+	e->gen = gen;
+	strcpy(e->hash, hash);
+	for (ix = 0; ix < FIT_CACHE_SEGMENTS; ix++)
+		e->crc[ix] = fit_cache_segment(data, size, ix);
+
+	/* the ramdisk and fdt are checked by the boot function, save now */
+	clean = !env_is_dirty();
+	if (!fit_cache_write(entry, count))
+		fit_cache_save(clean);
+}
+/*****************************************************************************/
+
+/*
+ * "length" bytes at "flash" are about to be written or erased. A new
+ * generation is only set in RAM here, fit_cache_note_done() saves it
+ * when the flash operation is over.
+ */
+void fit_cache_note_write(const char *media, unsigned long long flash,
+			  unsigned long long length)
+{
+	struct fit_cache_entry entry[CONFIG_FIT_CACHE_ENTRIES];
+	struct fit_cache_load *ld;
+	struct fit_cache_entry *e;
+	char buf[12];
+	int count;
+
+	/* RAM read from there is not what the flash holds any more */
+	for (ld = fit_cache_loads;
+	     ld < fit_cache_loads + CONFIG_FIT_CACHE_LOADS; ld++) {
+		if (ld->media && !strcmp(ld->media, media)
+		    && flash < ld->flash + ld->length
+		    && ld->flash < flash + length)
+			fit_cache_drop(ld);
+	}
+
+	count = fit_cache_read(entry);
+	for (e = entry; e < entry + count; e++) {
+		if (!strcmp(e->media, media) && flash < e->flash + e->length
+		    && e->flash < flash + length)
+			break;
+	}
+	if (e == entry + count)
+		return;
+
+	/* a new generation, none of the entries is valid any more */
+	fit_cache_gen_dirty = env_is_dirty() ? -1 : 1;
+	sprintf(buf, "%lu", fit_cache_gen() + 1);
+	setenv("fitgen", buf);
+	setenv("fitcache", NULL);
+}
+
+/* the write or erase of fit_cache_note_write() is done */
+void fit_cache_note_done(void)
+{
+	if (!fit_cache_gen_dirty)
+		return;
+	fit_cache_save(fit_cache_gen_dirty > 0);
+	fit_cache_gen_dirty = 0;
+}
+/*****************************************************************************/
+
+int do_fit_cache(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	struct fit_cache_entry entry[CONFIG_FIT_CACHE_ENTRIES];
+	struct fit_cache_load *ld;
+	struct fit_cache_entry *e;
+	ulong gen = fit_cache_gen();
+	int count, clean;
+
+	if (argc < 2 || !strcmp(argv[1], "list")) {
+		printf("generation %lu\n", gen);
+		count = fit_cache_read(entry);
+		for (e = entry; e < entry + count; e++)
+			printf("  %-4s 0x%08llx 0x%08lx %s %s\n", e->media,
+				e->flash, e->length, e->hash,
+				e->gen == gen ? "" : "(old)");
+		for (ld = fit_cache_loads;
+		     ld < fit_cache_loads + CONFIG_FIT_CACHE_LOADS; ld++) {
+			if (ld->media)
+				printf("loaded: %-4s 0x%08llx -> 0x%08lx,"
+					" 0x%08lx\n", ld->media, ld->flash,
+					ld->ram, ld->length);
+		}
+		return 0;
+	}
+	if (!strcmp(argv[1], "clear")) {
+		clean = !env_is_dirty();
+		setenv("fitcache", NULL);
+		return fit_cache_save(clean) ? 1 : 0;
+	}
+
+	cmd_usage(cmdtp);
+	return 1;
+}
+
+U_BOOT_CMD(
+	fitcache, 2, 0, do_fit_cache,
+	"verified FIT image cache",
+	"[list]\n"
+	"    - print the cached images and the flash reads they match\n"
+	"fitcache clear\n"
+	"    - forget all images, the next boot verifies them in full"
+);
@@ -0,0 +1,31 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * Hooks of the FIT verify cache (fit_cache.c) for the code that reads,
+ * writes and erases flash. "flash" is the byte offset on the device,
+ * "media" is "nand", "emmc" or "sf".
+ */
+
+#ifndef __FIT_CACHE_H__
+#define __FIT_CACHE_H__
+
+#ifdef CONFIG_FIT_VERIFY_CACHE
+/* "length" bytes at "flash" were read to "buf" */
+extern void fit_cache_note_read(const char *media, unsigned long long flash,
+	void *buf, unsigned int length);
+/* "length" bytes at "flash" are about to be written or erased */
+extern void fit_cache_note_write(const char *media, unsigned long long flash,
+	unsigned long long length);
+/* the write or erase is over, whatever the result */
+extern void fit_cache_note_done(void);
+#else
+#define fit_cache_note_read(media, flash, buf, length)	do { } while (0)
+#define fit_cache_note_write(media, flash, length)	do { } while (0)
+#define fit_cache_note_done()				do { } while (0)
+#endif
+
+#endif /* __FIT_CACHE_H__ */
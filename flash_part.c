@@ -9,88 +9,54 @@
 #include <linux/types.h>
 #include <linux/string.h>
 #include <nand.h>
+#include <malloc.h>
 
 /*****************************************************************************/
 
-static unsigned long long memparse(const char *ptr, char **retptr);
+struct flash_part_entry {
+	char *media;
+	char *name;
+	uint64_t start;
+	uint64_t length;
+};
+
+/*
+ * Partition table parsed from the last mtdparts string, sorted by
+ * media and name. It is rebuilt when the environment changed
+ * (get_env_id) or a different string is passed in. Names point into
+ * our own copy of the string.
+ */
+static struct flash_part_table {
+	int env_id;
+	const char *mtdparts;
+	char *copy;
+	struct flash_part_entry *part;
+	int count;
+} part_table;
 
-static int find_part(char *s, char **retptr, char *ptnname,
-					 uint64_t *start, uint64_t *length);
+static unsigned long long memparse(const char *ptr, char **retptr);
 
 /*****************************************************************************/
 
-int find_flash_part /* 1 - find, 0 - no find */
-(
- char *mtdparts,
- char *media_name,  /* hi_sfc, hinand */
- char *ptn_name,
- uint64_t *start,
- uint64_t *length
- )
+static int part_entry_cmp(const char *media, const char *name,
+			  struct flash_part_entry *entry)
 {
-	int rel;
-	char *s = (char *)mtdparts;
-
-	for( ; s != NULL; )
-	{
-		char *p;
-		(*start) = 0;
-
-		/* fetch <mtd-id> */
-		if (!(p = strchr(s, ':')))
-		{
-			printf("no mtd-id\n");
-			return 0;
-		}
-		else
-		{
-			*p = '\0';
-			rel = strcmp(s, media_name);
-			*p = ':';
-			if (rel)
-			{
-				if (!(p = strchr(s, ';')))
-					return 0;
-				s = p + 1;
-				continue;
-			}
-		}
-
-		/*
-		* parse one mtd. have it reserve memory for the
-		* struct cmdline_mtd_partition and the mtd-id string.
-		*/
-		rel =find_part(p + 1, &s, ptn_name, start, length);
+	int rel = strcmp(media, entry->media);
 
-		if (rel == 1)
-			return 1;
-		else if (rel == -1)
-			return 0;
-
-		/* EOS - we're done */
-		if (*s == 0)
-			break;
-
-		/* does another spec follow? */
-		if (*s != ';')
-			return 0;
-		s++;
-	}
-	return 0;
+	if (rel)
+		return rel;
+	return strcmp(name, entry->name);
 }
 /*****************************************************************************/
-
-static int find_part /* 0 - not find, 1 - find, -1 - error. */
-(
- char *s,
- char **retptr,
- char *ptnname,
- uint64_t *start,
- uint64_t *length
- )
+/*
+ * Parse one "<size>[@offset][(name)][ro][lk]" partition definition.
+ * return: 0 - ok, -1 - error.
+ */
+static int parse_part(char **ps, char **name, uint64_t *length)
 {
-	int isfind = 0;
-	char delim = 0;
+	char *s = *ps;
+
+	*name = NULL;
 
 	/* fetch the partition size */
 	if (*s == '-')
@@ -117,59 +83,181 @@ static int find_part /* 0 - not find, 1 - find, -1 - error. */
 
 	/* now look for name */
 	if (*s == '(')
-		delim = ')';
-
-	if (delim)
 	{
 		char *p;
-		char *name;
 
-		name = ++s;
-		p = strchr(name, delim);
+		*name = ++s;
+		p = strchr(s, ')');
 		if (!p)
 		{
-			printf("no closing %c found in partition name\n", delim);
+			printf("no closing %c found in partition name\n", ')');
 			return -1;
 		}
-
 		*p = '\0';
-		if (!strcmp(name, ptnname))
-			isfind = 1;
-		*p = ')';
 		s = p + 1;
 	}
 
 	/* test for options */
 	if (strncmp(s, "ro", 2) == 0)
-	{
 		s += 2;
-	}
 
 	/* if lk is found do NOT unlock the MTD partition*/
 	if (strncmp(s, "lk", 2) == 0)
-	{
 		s += 2;
+
+	*ps = s;
+	return 0;
+}
+/*****************************************************************************/
+
+static int build_part_table(char *mtdparts)
+{
+	struct flash_part_table *table = &part_table;
+	char *s;
+	int max;
+
+	free(table->copy);
+	free(table->part);
+	memset(table, 0, sizeof(*table));
+
+	/* every partition is followed by ',' or ';' except the last one */
+	for (max = 1, s = mtdparts; *s; s++)
+		if (*s == ',' || *s == ';')
+			max++;
+
+	table->copy = malloc(strlen(mtdparts) + 1);
+	table->part = malloc(max * sizeof(struct flash_part_entry));
+	if (!table->copy || !table->part)
+	{
+		printf("Out of memory.\n");
+		free(table->copy);
+		free(table->part);
+		memset(table, 0, sizeof(*table));
+		return -1;
 	}
+	strcpy(table->copy, mtdparts);
 
-	/* test if more partitions are following */
-	if (*s == ',')
+	for (s = table->copy; s && *s; )
 	{
-		int ret;
-		if ((*length) == (uint64_t)(-1))
+		char *p, *media;
+		uint64_t start = 0;
+		int error = 0;
+
+		/* fetch <mtd-id> */
+		if (!(p = strchr(s, ':')))
 		{
-			printf("no partitions allowed after a fill-up partition\n");
-			return -1;
+			printf("no mtd-id\n");
+			break;
+		}
+		*p = '\0';
+		media = s;
+		s = p + 1;
+
+		for (;;)
+		{
+			char *name;
+			uint64_t length;
+
+			if (parse_part(&s, &name, &length))
+			{
+				error = 1;
+				break;
+			}
+
+			if (name && table->count < max)
+			{
+				struct flash_part_entry *entry;
+				int ix;
+
+				/* sorted insert, keep the first of same names first */
+				for (ix = table->count; ix > 0; ix--)
+				{
+					if (part_entry_cmp(media, name,
+						&table->part[ix - 1]) >= 0)
+						break;
+					table->part[ix] = table->part[ix - 1];
+				}
+				entry = &table->part[ix];
+				entry->media  = media;
+				entry->name   = name;
+				entry->start  = start;
+				entry->length = length;
+				table->count++;
+			}
+
+			/* test if more partitions are following */
+			if (*s != ',')
+				break;
+			if (length == (uint64_t)(-1))
+			{
+				printf("no partitions allowed after a fill-up partition\n");
+				error = 1;
+				break;
+			}
+			start += length;
+			s++;
 		}
 
-		if (isfind)
-			return 1;
-		(*start) += (*length);
-		ret = find_part(s + 1, &s, ptnname, start, length);
-		*retptr = s;
-		return ret;
+		/* a broken spec only hides the rest of this <mtd-id> */
+		if (error)
+			s = strchr(s, ';');
+		else if (*s != ';')
+			break;
+		if (s)
+			s++;
+	}
+
+	table->env_id   = get_env_id();
+	table->mtdparts = mtdparts;
+	return 0;
+}
+/*****************************************************************************/
+
+int find_flash_part /* 1 - find, 0 - no find */
+(
+ char *mtdparts,
+ char *media_name,  /* hi_sfc, hinand */
+ char *ptn_name,
+ uint64_t *start,
+ uint64_t *length
+ )
+{
+	struct flash_part_table *table = &part_table;
+	int low, high;
+
+	/*
+	 * mtdparts is an environment value, it only changes together
+	 * with env_id. The string itself is never modified here.
+	 */
+	if (!table->copy
+		|| table->env_id != get_env_id()
+		|| table->mtdparts != mtdparts)
+	{
+		if (build_part_table(mtdparts))
+			return 0;
 	}
-	*retptr = s;
-	return isfind;
+
+	/* binary search the first entry not less than media:name */
+	low  = 0;
+	high = table->count;
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+
+		if (part_entry_cmp(media_name, ptn_name, &table->part[mid]) > 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low < table->count
+		&& !part_entry_cmp(media_name, ptn_name, &table->part[low]))
+	{
+		(*start)  = table->part[low].start;
+		(*length) = table->part[low].length;
+		return 1;
+	}
+	return 0;
 }
 /*****************************************************************************/
 
@@ -59,10 +59,19 @@ static int fit_check_ramdisk (const void *fit, int os_noffset,
 		uint8_t arch, int verify);
 #endif
 
+#ifdef CONFIG_FIT_VERIFY_CACHE
+extern int fit_cache_check (const void *fit, int image_noffset,
+		const void *data, size_t size);
+extern void fit_cache_add (const void *fit, int image_noffset,
+		const void *data, size_t size);
+#endif
+
 #ifdef CONFIG_CMD_BDI
 extern int do_bdinfo(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[]);
 #endif
 
+#include "bootstage.h"
+
 DECLARE_GLOBAL_DATA_PTR;
 
 static const image_header_t* image_get_ramdisk (ulong rd_addr, uint8_t arch,
@@ -74,6 +83,8 @@ static const image_header_t* image_get_ramdisk (ulong rd_addr, uint8_t arch,
 #include <image.h>
 #endif /* !USE_HOSTCC*/
 
+#include "image_comp.h"
+
 static table_entry_t uimage_arch[] = {
 	{	IH_ARCH_INVALID,	NULL,		"Invalid ARCH",	},
 	{	IH_ARCH_ALPHA,		"alpha",	"Alpha",	},
@@ -149,11 +160,22 @@ static table_entry_t uimage_comp[] = {
 	{	IH_COMP_GZIP,	"gzip",		"gzip compressed",	},
 	{	IH_COMP_LZMA,	"lzma",		"lzma compressed",	},
 	{	IH_COMP_LZO,	"lzo",		"lzo compressed",	},
+	{	IH_COMP_LZ4,	"lz4",		"lz4 compressed",	},
+	{	IH_COMP_ZSTD,	"zstd",		"zstd compressed",	},
+	{	IH_COMP_BLOCK,	"block",	"block compressed",	},
 	{	-1,		"",		"",			},
 };
 
 uint32_t crc32 (uint32_t, const unsigned char *, uint);
 uint32_t crc32_wd (uint32_t, const unsigned char *, uint, uint);
+
+/* data CRCs with the slice-by-8 CRC, crc32_wd() without it */
+#if defined(CONFIG_CRC32_SLICE8) && !defined(USE_HOSTCC)
+uint32_t crc32_slice8_wd (uint32_t, const unsigned char *, uint, uint);
+#define image_crc32_wd		crc32_slice8_wd
+#else
+#define image_crc32_wd		crc32_wd
+#endif
 #if defined(CONFIG_TIMESTAMP) || defined(CONFIG_CMD_DATE) || defined(USE_HOSTCC)
 static void genimg_print_time (time_t timestamp);
 #endif
@@ -180,7 +202,8 @@ int image_check_dcrc (const image_header_t *hdr)
 {
 	ulong data = image_get_data (hdr);
 	ulong len = image_get_data_size (hdr);
-	ulong dcrc = crc32_wd (0, (unsigned char *)data, len, CHUNKSZ_CRC32);
+	ulong dcrc = image_crc32_wd (0, (unsigned char *)data, len,
+					CHUNKSZ_CRC32);
 
 	return (dcrc == image_get_dcrc (hdr));
 }
@@ -1251,6 +1274,10 @@ int boot_relocate_fdt (struct lmb *lmb, ulong bootmap_base,
 		*of_size = of_len;
 	}
 
+	/* the relocated blob has room for the boot stage marks */
+	bootstage_mark("fdt_relocate");
+	bootstage_fdt_add(*of_flat_tree);
+
 	set_working_fdt_addr(*of_flat_tree);
 	return 0;
 
@@ -2418,7 +2445,7 @@ static int calculate_hash (const void *data, int data_len, const char *algo,
 			uint8_t *value, int *value_len)
 {
 	if (strcmp (algo, "crc32") == 0 ) {
-		*((uint32_t *)value) = crc32_wd (0, data, data_len,
+		*((uint32_t *)value) = image_crc32_wd (0, data, data_len,
 							CHUNKSZ_CRC32);
 		*((uint32_t *)value) = cpu_to_uimage (*((uint32_t *)value));
 		*value_len = 4;
@@ -2639,6 +2666,14 @@ int fit_image_check_hashes (const void *fit, int image_noffset)
 		return 0;
 	}
 
+#if defined(CONFIG_FIT_VERIFY_CACHE) && !defined(USE_HOSTCC)
+	/* verified before from the same flash, not written since */
+	if (fit_cache_check (fit, image_noffset, data, size)) {
+		printf ("cached+ ");
+		return 1;
+	}
+#endif
+
 	/* Process all hash subnodes of the component image node */
 	for (ndepth = 0, noffset = fdt_next_node (fit, image_noffset, &ndepth);
 	     (noffset >= 0) && (ndepth > 0);
@@ -2686,6 +2721,9 @@ int fit_image_check_hashes (const void *fit, int image_noffset)
 		}
 	}
 
+#if defined(CONFIG_FIT_VERIFY_CACHE) && !defined(USE_HOSTCC)
+	fit_cache_add (fit, image_noffset, data, size);
+#endif
 	return 1;
 
 error:
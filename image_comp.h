@@ -0,0 +1,27 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * IH_COMP_* types added to this tree. They are written into images, so
+ * they are defined here once, for image.c (also in mkimage), bootm and
+ * the decompressors. The values of upstream are kept where it has them,
+ * our own types are at 0x80 and up, out of its way.
+ */
+
+#ifndef __IMAGE_COMP_H__
+#define __IMAGE_COMP_H__
+
+#ifndef IH_COMP_LZ4
+#define IH_COMP_LZ4		5	/* lz4 compression */
+#endif
+#ifndef IH_COMP_ZSTD
+#define IH_COMP_ZSTD		6	/* zstd compression */
+#endif
+#ifndef IH_COMP_BLOCK
+#define IH_COMP_BLOCK		0x80	/* block compressed, bootm_block.c */
+#endif
+
+#endif /* __IMAGE_COMP_H__ */
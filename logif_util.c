@@ -0,0 +1,41 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * Helpers shared by the nand/spiflash/emmc logic interfaces.
+ */
+
+#include <common.h>
+
+#include "logif_util.h"
+
+/*****************************************************************************/
+/*
+ * Compared a word at a time, the buffer may have any alignment.
+ *
+ * return  - 1: all bytes are 0xFF, 0: not.
+ */
+int logic_is_erased(const unsigned char *buf, unsigned int length)
+{
+	const unsigned long *word;
+
+	for (; length > 0 && ((unsigned long)buf & (sizeof(*word) - 1));
+	     length--)
+		if (*buf++ != 0xFF)
+			return 0;
+
+	word = (const unsigned long *)buf;
+	for (; length >= sizeof(*word); length -= sizeof(*word))
+		if (*word++ != ~0UL)
+			return 0;
+
+	for (buf = (const unsigned char *)word; length > 0; length--)
+		if (*buf++ != 0xFF)
+			return 0;
+
+	return 1;
+}
+/*****************************************************************************/
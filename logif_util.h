@@ -0,0 +1,75 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * Helpers shared by the nand/spiflash/emmc logic interfaces, and the
+ * calls of this tree which are not in their headers yet.
+ */
+
+#ifndef __LOGIF_UTIL_H__
+#define __LOGIF_UTIL_H__
+
+/* return  - 1: all "length" bytes at "buf" are 0xFF, 0: not. */
+extern int logic_is_erased(const unsigned char *buf, unsigned int length);
+
+#ifdef CONFIG_CMD_NAND
+#include <nand_logif.h>
+
+/* differential program, see nand_logif.c */
+extern int nand_logic_write_diff(nand_logic_t *nand_logic,
+	unsigned long long offset, unsigned long long length,
+	unsigned char *buf, unsigned int buflen);
+#endif /* CONFIG_CMD_NAND */
+
+#ifdef CONFIG_CMD_SF
+#include <spiflash_logif.h>
+
+/* differential program, see spiflash_logif.c */
+extern int spiflash_logic_write_diff(spiflash_logic_t *spiflash_logic,
+	unsigned long long offset, unsigned long long length,
+	unsigned char *buf, unsigned int buflen);
+#endif /* CONFIG_CMD_SF */
+
+#ifdef CONFIG_CMD_MMC
+#include <emmc_logif.h>
+
+/* differential write, see emmc_logif.c */
+extern int emmc_logic_write_diff(emmc_logic_t *emmc_logic,
+	unsigned long long offset, unsigned int length, unsigned char *buf);
+
+/*
+ * Scatter-gather access: the segments are one continuous range of the
+ * handle from "offset", any byte offset and segment length will do.
+ */
+struct emmc_logic_sg {
+	unsigned char *buf;
+	unsigned int length;
+};
+
+extern int emmc_logic_writev(emmc_logic_t *emmc_logic,
+	unsigned long long offset, struct emmc_logic_sg *sg, int count);
+extern int emmc_logic_readv(emmc_logic_t *emmc_logic,
+	unsigned long long offset, struct emmc_logic_sg *sg, int count);
+
+/*
+ * Double-buffered streaming write, "poll" is called while a chunk is
+ * written so the producer keeps receiving. See emmc_logif.c.
+ */
+typedef struct emmc_logic_stream emmc_logic_stream_t;
+
+extern emmc_logic_stream_t *emmc_logic_stream_open(emmc_logic_t *emmc_logic,
+	unsigned long long offset, unsigned int chunk,
+	void (*poll)(void *arg), void *arg);
+extern unsigned int emmc_logic_stream_space(emmc_logic_stream_t *stream,
+	unsigned char **buf);
+extern int emmc_logic_stream_commit(emmc_logic_stream_t *stream,
+	unsigned int length);
+extern int emmc_logic_stream_write(emmc_logic_stream_t *stream,
+	const unsigned char *data, unsigned int length);
+extern int emmc_logic_stream_close(emmc_logic_stream_t *stream);
+#endif /* CONFIG_CMD_MMC */
+
+#endif /* __LOGIF_UTIL_H__ */
@@ -0,0 +1,192 @@
+/******************************************************************************
+*    Copyright (c) 2009-2012 by Hisi.
+*    All rights reserved.
+* ***
+*
+******************************************************************************/
+/*
+ * LZ4 decompression, as written by "lz4": the frame format (magic
+ * 0x184D2204) and the legacy format of "lz4 -l" and the kernel
+ * (0x184C2102). Blocks may be linked, the output is one buffer, so
+ * matches into the previous blocks need nothing special. Header, block
+ * and content checksums are skipped, the image CRC covers the data.
+ * No dictionaries. Nothing is allocated, so it is safe on any core.
+ */
+
+#include <common.h>
+
+#define LZ4F_MAGIC		0x184D2204
+#define LZ4_LEGACY_MAGIC	0x184C2102
+#define LZ4_LEGACY_BLOCK	(8 << 20)
+
+#define LZ4F_VERSION_MASK	0xc0
+#define LZ4F_VERSION		0x40
+#define LZ4F_BLOCK_CHECKSUM	0x10
+#define LZ4F_CONTENT_SIZE	0x08
+#define LZ4F_CONTENT_CHECKSUM	0x04
+#define LZ4F_RESERVED		0x02
+#define LZ4F_DICT_ID		0x01
+
+#define LZ4F_UNCOMPRESSED	0x80000000
+
+#define LZ4_MIN_MATCH		4
+
+static inline u32 lz4_le32(const u8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+/* a 4 bit length and its 255 extension bytes */
+static inline int lz4_length(const u8 **ip, const u8 *iend, size_t *len)
+{
+	u8 b;
+
+	if (*len != 15)
+		return 0;
+	do {
+		if (*ip >= iend)
+			return -1;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return 0;
+}
+
+/*
+ * One block of "srcn" bytes to "*op", up to "oend". "obase" is the
+ * start of the output, matches may reach back to it.
+ */
+static int lz4_block(const u8 *ip, size_t srcn, u8 *obase, u8 **op, u8 *oend)
+{
+	const u8 *iend = ip + srcn;
+	const u8 *match;
+	u8 *o = *op;
+	size_t len, offset;
+	u8 token;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		/* literals */
+		len = token >> 4;
+		if (lz4_length(&ip, iend, &len))
+			return -1;
+		if (len > (size_t)(iend - ip) || len > (size_t)(oend - o))
+			return -1;
+		memcpy(o, ip, len);
+		o += len;
+		ip += len;
+		if (ip == iend)
+			break;		/* the last sequence has no match */
+
+		/* match */
+		if (iend - ip < 2)
+			return -1;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (!offset || offset > (size_t)(o - obase))
+			return -1;
+		len = token & 15;
+		if (lz4_length(&ip, iend, &len))
+			return -1;
+		len += LZ4_MIN_MATCH;
+		if (len > (size_t)(oend - o))
+			return -1;
+
+		match = o - offset;
+		if (offset >= len) {
+			memcpy(o, match, len);
+			o += len;
+		} else {
+			/* overlapping, repeats the last "offset" bytes */
+			while (len--)
+				*o++ = *match++;
+		}
+	}
+	*op = o;
+	return 0;
+}
+
+static int lz4_legacy(const u8 *ip, const u8 *iend, u8 *obase, u8 **op,
+		      u8 *oend)
+{
+	u32 size;
+
+	while (iend - ip >= 4) {
+		size = lz4_le32(ip);
+		/* the end, or the next frame of a concatenated file */
+		if (size == 0 || size == LZ4_LEGACY_MAGIC)
+			break;
+		ip += 4;
+		if (size > LZ4_LEGACY_BLOCK || size > (u32)(iend - ip))
+			return -1;
+		if (lz4_block(ip, size, obase, op, oend))
+			return -1;
+		ip += size;
+	}
+	return 0;
+}
+
+/*
+ * Uncompress "srcn" bytes at "src" to "dst". "dstn" is the room at
+ * "dst" and returns the uncompressed size. Returns 0 or -1.
+ */
+int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
+{
+	const u8 *ip = src;
+	const u8 *iend = ip + srcn;
+	u8 *op = dst;
+	u8 *oend = op + *dstn;
+	u32 size;
+	u8 flags;
+
+	if (srcn < 4)
+		return -1;
+	if (lz4_le32(ip) == LZ4_LEGACY_MAGIC) {
+		if (lz4_legacy(ip + 4, iend, dst, &op, oend))
+			return -1;
+		*dstn = op - (u8 *)dst;
+		return 0;
+	}
+	if (lz4_le32(ip) != LZ4F_MAGIC || srcn < 7)
+		return -1;
+	ip += 4;
+
+	/* frame descriptor: flags, block size, [content size], checksum */
+	flags = ip[0];
+	if ((flags & LZ4F_VERSION_MASK) != LZ4F_VERSION
+	    || (flags & (LZ4F_RESERVED | LZ4F_DICT_ID)))
+		return -1;
+	ip += 2;
+	if (flags & LZ4F_CONTENT_SIZE)
+		ip += 8;
+	ip++;
+
+	for (;;) {
+		if (iend - ip < 4)
+			return -1;
+		size = lz4_le32(ip);
+		ip += 4;
+		if (size == 0)
+			break;		/* end mark */
+
+		if (size & LZ4F_UNCOMPRESSED) {
+			size &= ~LZ4F_UNCOMPRESSED;
+			if (size > (u32)(iend - ip) || size > (u32)(oend - op))
+				return -1;
+			memcpy(op, ip, size);
+			op += size;
+		} else {
+			if (size > (u32)(iend - ip))
+				return -1;
+			if (lz4_block(ip, size, dst, &op, oend))
+				return -1;
+		}
+		ip += size;
+		if (flags & LZ4F_BLOCK_CHECKSUM)
+			ip += 4;
+	}
+
+	*dstn = op - (u8 *)dst;
+	return 0;
+}
@@ -30,7 +30,7 @@
 #include <common.h>
 #include <watchdog.h>
 #include <command.h>
-#ifdef CONFIG_MODEM_SUPPORT
+#if defined(CONFIG_MODEM_SUPPORT) || defined(CONFIG_RUN_COMMAND_CACHE)
 #include <malloc.h>		/* for free() prototype */
 #endif
 
@@ -39,15 +39,24 @@
 #endif
 
 #include <post.h>
+#include "bootstage.h"
 
-#if defined(CONFIG_SILENT_CONSOLE) || defined(CONFIG_POST) || defined(CONFIG_CMDLINE_EDITING)
+#if defined(CONFIG_SILENT_CONSOLE) || defined(CONFIG_POST) || defined(CONFIG_CMDLINE_EDITING) \
+	|| defined(CONFIG_RUN_COMMAND_CACHE)
 DECLARE_GLOBAL_DATA_PTR;
 #endif
 
 /*
  * Board-specific Platform code can reimplement show_boot_progress () if needed
  */
+#ifdef CONFIG_BOOTSTAGE
+void __show_boot_progress (int val)
+{
+	bootstage_progress(val);
+}
+#else
 void inline __show_boot_progress (int val) {}
+#endif
 void show_boot_progress (int val) __attribute__((weak, alias("__show_boot_progress")));
 
 #if defined(CONFIG_BOOT_RETRY_TIME) && defined(CONFIG_RESET_TO_RETRY)
@@ -308,6 +317,8 @@ void main_loop (void)
 	trab_vfd (bmp);
 #endif	/* CONFIG_VFD && VFD_TEST_LOGO */
 
+	bootstage_mark("main_loop");
+
 #ifdef CONFIG_BOOTCOUNT_LIMIT
 	bootcount = bootcount_load();
 	bootcount++;
@@ -402,15 +413,18 @@ void main_loop (void)
 
 	/* add by liangdongcai, 2012-03-09 */
 	cfe_upd_init();
+	bootstage_mark("cfe_upd_init");
 
 	if (bootdelay >= 0 && !abortboot (bootdelay)) {
 # ifdef CONFIG_AUTOBOOT_KEYED
 		int prev = disable_ctrlc(1);	/* disable Control C checking */
 # endif
+		bootstage_mark("bootdelay");
 
 #if 1
 	    /* add by liangdongcai, 2012-03-02 */
 	    cfe_upd_load();
+	    bootstage_mark("cfe_upd_load");
 #else
 	    if (s) {
 # ifndef CONFIG_SYS_HUSH_PARSER
@@ -1174,42 +1188,126 @@ int parse_line (char *line, char *argv[])
 	return (nargs);
 }
 
-/****************************************************************************/
+/****************************************************************************
+ * Macro expansion for run_command(). The expanded command starts out in
+ * the caller's buffer and moves to the heap when it does not fit, once
+ * relocated. A command that cannot be expanded in full is reported and
+ * not run, rather than cut short.
+ */
+struct macro_buf {
+	char *buf;
+	int size;
+	char *heap;		/* buf if malloc'ed, else NULL	*/
+};
 
-static void process_macros (const char *input, char *output)
+/*
+ * Variables looked up while expanding one command line, so a name used
+ * twice is looked up once. Values point into the environment, they are
+ * dropped when it changes (env_id).
+ */
+#ifndef CONFIG_SYS_MACRO_VARS
+#define CONFIG_SYS_MACRO_VARS	16
+#endif
+
+struct macro_vars {
+	int env_id;
+	int count;
+	struct {
+		const char *name;	/* in the command, not terminated */
+		int len;
+		char *val;
+	} var[CONFIG_SYS_MACRO_VARS];
+};
+
+/* make room for "len" more chars after "used" ones (and a '\0') */
+static int macro_grow (struct macro_buf *mb, int used, int len)
+{
+	char *buf;
+	int size = mb->size;
+
+	if (!(gd->flags & GD_FLG_RELOC))
+		return -1;
+	while (size <= used + len)
+		size *= 2;
+	if ((buf = malloc(size)) == NULL)
+		return -1;
+	memcpy(buf, mb->buf, used);
+	if (mb->heap)
+		free(mb->heap);
+	mb->buf = mb->heap = buf;
+	mb->size = size;
+	return 0;
+}
+
+static char *macro_getenv (struct macro_vars *vars, const char *name, int len)
+{
+	char envname[CONFIG_SYS_CBSIZE];
+	char *val;
+	int i;
+
+	if (vars->env_id != get_env_id()) {
+		vars->env_id = get_env_id();
+		vars->count = 0;
+	}
+	for (i = 0; i < vars->count; i++) {
+		if (vars->var[i].len == len &&
+		    !memcmp(vars->var[i].name, name, len))
+			return vars->var[i].val;
+	}
+
+	memcpy(envname, name, len);
+	envname[len] = '\0';
+	val = getenv(envname);
+
+	if (vars->count < CONFIG_SYS_MACRO_VARS) {
+		vars->var[i].name = name;
+		vars->var[i].len  = len;
+		vars->var[i].val  = val;
+		vars->count++;
+	}
+	return val;
+}
+
+/* returns 0, or -1 if the expanded command does not fit */
+static int process_macros (const char *input, struct macro_buf *mb,
+			   struct macro_vars *vars)
 {
 	char c, prev;
 	const char *varname_start = NULL;
-	int inputcnt = strlen (input);
-	int outputcnt = CONFIG_SYS_CBSIZE;
+	char *output = mb->buf;
+	int outputcnt = 0;	/* chars in output */
 	int state = 0;		/* 0 = waiting for '$'  */
+	int need;
 
 	/* 1 = waiting for '(' or '{' */
 	/* 2 = waiting for ')' or '}' */
 	/* 3 = waiting for '''  */
 #ifdef DEBUG_PARSER
-	char *output_start = output;
-
 	printf ("[PROCESS_MACROS] INPUT len %d: \"%s\"\n", strlen (input),
 		input);
 #endif
 
 	prev = '\0';		/* previous character   */
 
-	while (inputcnt && outputcnt) {
-		c = *input++;
-		inputcnt--;
-
+	while ((c = *input++) != '\0') {
 		if (state != 3) {
 			/* remove one level of escape characters */
 			if ((c == '\\') && (prev != '\\')) {
-				if (inputcnt-- == 0)
+				if (*input == '\0')
 					break;
 				prev = c;
 				c = *input++;
 			}
 		}
 
+		/* room for c ('$' and c in state 1) and the '\0' */
+		need = (state == 1) ? 2 : 1;
+		if (outputcnt + need >= mb->size) {
+			if (macro_grow (mb, outputcnt, need))
+				goto overflow;
+			output = mb->buf;
+		}
+
 		switch (state) {
 		case 0:	/* Waiting for (unescaped) $    */
 			if ((c == '\'') && (prev != '\\')) {
@@ -1219,8 +1317,7 @@ static void process_macros (const char *input, char *output)
 			if ((c == '$') && (prev != '\\')) {
 				state++;
 			} else {
-				*(output++) = c;
-				outputcnt--;
+				output[outputcnt++] = c;
 			}
 			break;
 		case 1:	/* Waiting for (        */
@@ -1229,36 +1326,31 @@ static void process_macros (const char *input, char *output)
 				varname_start = input;
 			} else {
 				state = 0;
-				*(output++) = '$';
-				outputcnt--;
-
-				if (outputcnt) {
-					*(output++) = c;
-					outputcnt--;
-				}
+				output[outputcnt++] = '$';
+				output[outputcnt++] = c;
 			}
 			break;
 		case 2:	/* Waiting for )        */
 			if (c == ')' || c == '}') {
-				int i;
-				char envname[CONFIG_SYS_CBSIZE], *envval;
-				int envcnt = input - varname_start - 1;	/* Varname # of chars */
-
-				/* Get the varname */
-				for (i = 0; i < envcnt; i++) {
-					envname[i] = varname_start[i];
-				}
-				envname[i] = 0;
+				/* Varname # of chars */
+				int envcnt = input - varname_start - 1;
+				char *envval;
+				int len;
 
 				/* Get its value */
-				envval = getenv (envname);
+				envval = macro_getenv (vars, varname_start, envcnt);
 
 				/* Copy into the line if it exists */
-				if (envval != NULL)
-					while ((*envval) && outputcnt) {
-						*(output++) = *(envval++);
-						outputcnt--;
+				if (envval != NULL) {
+					len = strlen (envval);
+					if (outputcnt + len >= mb->size) {
+						if (macro_grow (mb, outputcnt, len))
+							goto overflow;
+						output = mb->buf;
 					}
+					memcpy (output + outputcnt, envval, len);
+					outputcnt += len;
+				}
 				/* Look for another '$' */
 				state = 0;
 			}
@@ -1267,25 +1359,283 @@ static void process_macros (const char *input, char *output)
 			if ((c == '\'') && (prev != '\\')) {
 				state = 0;
 			} else {
-				*(output++) = c;
-				outputcnt--;
+				output[outputcnt++] = c;
 			}
 			break;
 		}
 		prev = c;
 	}
 
-	if (outputcnt)
-		*output = 0;
-	else
-		*(output - 1) = 0;
+	output[outputcnt] = '\0';
 
 #ifdef DEBUG_PARSER
 	printf ("[PROCESS_MACROS] OUTPUT len %d: \"%s\"\n",
-		strlen (output_start), output_start);
+		strlen (output), output);
 #endif
+	return 0;
+
+overflow:
+	printf ("## Command too long after macro expansion (%d bytes)\n",
+		mb->size);
+	return -1;
 }
 
+/****************************************************************************
+ * Run one command of a run_command() line. "finaltoken" is the command
+ * after macro expansion; "cmdtp" is its table entry if already known,
+ * else NULL. The flag and repeatable state of the line are updated.
+ * returns:
+ *	0  - command executed
+ *	-1 - command failed or not executed
+ *	-2 - interrupted, stop the line
+ */
+static int run_token (char *finaltoken, cmd_tbl_t *cmdtp, int *flag,
+		      int *repeatable)
+{
+	char *argv[CONFIG_SYS_MAXARGS + 1];	/* NULL terminated	*/
+	int argc;
+	int rc = 0;
+
+	/* Extract arguments */
+	if ((argc = parse_line (finaltoken, argv)) == 0)
+		return -1;	/* no command at all */
+
+	/* Look up command in command table */
+	if (!cmdtp && (cmdtp = find_cmd(argv[0])) == NULL) {
+		printf ("Unknown command '%s' - try 'help'\n", argv[0]);
+		return -1;	/* give up after bad command */
+	}
+
+	/* found - check max args */
+	if (argc > cmdtp->maxargs) {
+		cmd_usage(cmdtp);
+		return -1;
+	}
+
+#if defined(CONFIG_CMD_BOOTD)
+	/* avoid "bootd" recursion */
+	if (cmdtp->cmd == do_bootd) {
+#ifdef DEBUG_PARSER
+		printf ("[%s]\n", finaltoken);
+#endif
+		if (*flag & CMD_FLAG_BOOTD) {
+			puts ("'bootd' recursion detected\n");
+			return -1;
+		} else {
+			*flag |= CMD_FLAG_BOOTD;
+		}
+	}
+#endif
+
+	/* OK - call function to do the command */
+	if ((cmdtp->cmd) (cmdtp, *flag, argc, argv) != 0) {
+		rc = -1;
+	}
+
+	*repeatable &= cmdtp->repeatable;
+
+	/* Did the user stop this? */
+	if (had_ctrlc ())
+		return -2;	/* if stopped then not repeatable */
+
+	return rc;
+}
+
+/*
+ * Expand the macros of one command and run it, see run_token(). A
+ * command without '$', '\\' or '\'' is run in place if "token" may be
+ * modified ("in_place"), as expanding it would only copy it.
+ */
+static int run_expanded (char *token, cmd_tbl_t *cmdtp, int in_place,
+			 struct macro_vars *vars, int *flag, int *repeatable)
+{
+	char finaltoken[CONFIG_SYS_CBSIZE];
+	struct macro_buf mb;
+	int ret;
+
+	if (in_place && !strpbrk(token, "$\\'"))
+		return run_token (token, cmdtp, flag, repeatable);
+
+	mb.buf  = finaltoken;
+	mb.size = sizeof(finaltoken);
+	mb.heap = NULL;
+
+	/* find macros in this token and replace them */
+	if (process_macros (token, &mb, vars))
+		return -1;
+
+	ret = run_token (mb.buf, cmdtp, flag, repeatable);
+	if (mb.heap)
+		free(mb.heap);
+	return ret;
+}
+
+/*
+ * Find the next command of a line in "str", terminate it and return
+ * where the next one starts. Allow simple escape of ';' by writing "\;"
+ */
+static char *split_token (char *str)
+{
+	char *sep;
+	int inquotes;
+
+	for (inquotes = 0, sep = str; *sep; sep++) {
+		if ((*sep=='\'') &&
+		    (*(sep-1) != '\\'))
+			inquotes=!inquotes;
+
+		if (!inquotes &&
+		    (*sep == ';') &&	/* separator		*/
+		    ( sep != str) &&	/* past string start	*/
+		    (*(sep-1) != '\\'))	/* and NOT escaped	*/
+			break;
+	}
+
+	/*
+	 * Limit the token to data between separators
+	 */
+	if (*sep) {
+		*sep = '\0';
+		return sep + 1;	/* start of command for next pass */
+	}
+	return sep;		/* no more commands for next pass */
+}
+
+#ifdef CONFIG_RUN_COMMAND_CACHE
+/****************************************************************************
+ * Cache of split command lines for run_command(), so a script that is run
+ * again (bootcmd, "run" in a loop) skips splitting it into commands and
+ * looking the commands up. A command without '$', '\\' or '\'' comes out
+ * of process_macros() unchanged, its table entry is looked up once. The
+ * others still get their macros expanded and are looked up on each run,
+ * the variables may change while the line runs. Entries are only reused
+ * when no run_command() is working on them.
+ */
+#ifndef CONFIG_RUN_COMMAND_CACHE_ENTRIES
+#define CONFIG_RUN_COMMAND_CACHE_ENTRIES	8
+#endif
+
+struct run_cache_token {
+	char *text;		/* command, '\0' terminated	*/
+	cmd_tbl_t *cmdtp;	/* NULL: expand and look up	*/
+};
+
+struct run_cache {
+	unsigned int hash;
+	int len;
+	int busy;		/* run_command()s using the entry */
+	unsigned long used;	/* for LRU */
+	char *line;		/* the command line as given	*/
+	int count;
+	struct run_cache_token *token;
+};
+
+static struct run_cache run_cache[CONFIG_RUN_COMMAND_CACHE_ENTRIES];
+static unsigned long run_cache_used;
+
+static unsigned int run_cache_hash (const char *cmd, int *len)
+{
+	unsigned int hash = 5381;
+	const char *s = cmd;
+
+	while (*s)
+		hash = hash * 33 + *s++;
+	*len = s - cmd;
+	return hash;
+}
+
+/* split "cmd" into the entry, the entry is unused */
+static int run_cache_fill (struct run_cache *rc, const char *cmd, int len)
+{
+	char *start[CONFIG_SYS_CBSIZE / 2 + 1];
+	char *buf, *str, *token;
+	cmd_tbl_t *cmdtp;
+	int ix, count = 0;
+
+	/* '\0' ahead of the copy, for the look back at the first char */
+	buf = malloc(2 * (len + 2));
+	if (!buf)
+		return -1;
+	buf[0] = '\0';
+	str = buf + 1;
+	strcpy(str, cmd);
+
+	while (*str) {
+		start[count++] = str;
+		str = split_token(str);
+	}
+
+	rc->token = malloc(count * sizeof(struct run_cache_token));
+	if (!rc->token) {
+		free(buf);
+		return -1;
+	}
+
+	rc->line = buf + len + 2;
+	strcpy(rc->line, cmd);
+	rc->count = count;
+
+	for (ix = 0; ix < count; ix++) {
+		token = start[ix];
+		cmdtp = NULL;
+		if (!strpbrk(token, "$\\'")) {
+			/* the first word, as parse_line() will find it */
+			char name[CONFIG_SYS_CBSIZE];
+			int n = 0;
+
+			while ((*token == ' ') || (*token == '\t'))
+				++token;
+			while (token[n] && (token[n] != ' ') && (token[n] != '\t'))
+				n++;
+			if (n) {
+				memcpy(name, token, n);
+				name[n] = '\0';
+				cmdtp = find_cmd(name);
+			}
+		}
+		rc->token[ix].text  = start[ix];
+		rc->token[ix].cmdtp = cmdtp;
+	}
+	return 0;
+}
+
+static struct run_cache *run_cache_get (const char *cmd)
+{
+	struct run_cache *rc, *victim = NULL;
+	unsigned int hash;
+	int len;
+
+	if (!(gd->flags & GD_FLG_RELOC))
+		return NULL;
+
+	hash = run_cache_hash(cmd, &len);
+	for (rc = run_cache;
+	     rc != run_cache + CONFIG_RUN_COMMAND_CACHE_ENTRIES; rc++) {
+		if (rc->line && rc->hash == hash && rc->len == len
+		    && !strcmp(rc->line, cmd)) {
+			rc->used = ++run_cache_used;
+			return rc;
+		}
+		if (!rc->busy && (!victim || rc->used < victim->used))
+			victim = rc;
+	}
+	if (!victim)
+		return NULL;
+
+	if (victim->line) {
+		free(victim->line - victim->len - 2);
+		free(victim->token);
+		victim->line = NULL;
+	}
+	if (run_cache_fill(victim, cmd, len))
+		return NULL;
+	victim->hash = hash;
+	victim->len  = len;
+	victim->used = ++run_cache_used;
+	return victim;
+}
+#endif /* CONFIG_RUN_COMMAND_CACHE */
+
 /****************************************************************************
  * returns:
  *	1  - command executed, repeatable
@@ -1305,16 +1655,17 @@ static void process_macros (const char *input, char *output)
 
 int run_command (const char *cmd, int flag)
 {
-	cmd_tbl_t *cmdtp;
-	char cmdbuf[CONFIG_SYS_CBSIZE];	/* working copy of cmd		*/
+	char cmdbuf[CONFIG_SYS_CBSIZE + 1];	/* working copy of cmd	*/
 	char *token;			/* start of token in cmdbuf	*/
-	char *sep;			/* end of token (separator) in cmdbuf */
-	char finaltoken[CONFIG_SYS_CBSIZE];
-	char *str = cmdbuf;
-	char *argv[CONFIG_SYS_MAXARGS + 1];	/* NULL terminated	*/
-	int argc, inquotes;
+	struct macro_vars vars;
+	char *str = cmdbuf + 1;		/* '\0' ahead for split_token() */
 	int repeatable = 1;
 	int rc = 0;
+	int ret;
+#ifdef CONFIG_RUN_COMMAND_CACHE
+	struct run_cache *cache;
+	int ix;
+#endif
 
 #ifdef DEBUG_PARSER
 	printf ("[RUN_COMMAND] cmd[%p]=\"", cmd);
@@ -1333,7 +1684,33 @@ int run_command (const char *cmd, int flag)
 		return -1;
 	}
 
-	strcpy (cmdbuf, cmd);
+	vars.env_id = 0;
+	vars.count = 0;
+
+#ifdef CONFIG_RUN_COMMAND_CACHE
+	if ((cache = run_cache_get(cmd)) != NULL) {
+		cache->busy++;
+		for (ix = 0; ix < cache->count; ix++) {
+			token = cache->token[ix].text;
+#ifdef DEBUG_PARSER
+			printf ("token: \"%s\"\n", token);
+#endif
+			ret = run_expanded (token, cache->token[ix].cmdtp, 0,
+					    &vars, &flag, &repeatable);
+			if (ret == -2) {
+				cache->busy--;
+				return -1;
+			}
+			if (ret)
+				rc = ret;
+		}
+		cache->busy--;
+		return rc ? rc : repeatable;
+	}
+#endif /* CONFIG_RUN_COMMAND_CACHE */
+
+	cmdbuf[0] = '\0';
+	strcpy (str, cmd);
 
 	/* Process separators and check for invalid
 	 * repeatable commands
@@ -1343,86 +1720,17 @@ int run_command (const char *cmd, int flag)
 	printf ("[PROCESS_SEPARATORS] %s\n", cmd);
 #endif
 	while (*str) {
-
-		/*
-		 * Find separator, or string end
-		 * Allow simple escape of ';' by writing "\;"
-		 */
-		for (inquotes = 0, sep = str; *sep; sep++) {
-			if ((*sep=='\'') &&
-			    (*(sep-1) != '\\'))
-				inquotes=!inquotes;
-
-			if (!inquotes &&
-			    (*sep == ';') &&	/* separator		*/
-			    ( sep != str) &&	/* past string start	*/
-			    (*(sep-1) != '\\'))	/* and NOT escaped	*/
-				break;
-		}
-
-		/*
-		 * Limit the token to data between separators
-		 */
 		token = str;
-		if (*sep) {
-			str = sep + 1;	/* start of command for next pass */
-			*sep = '\0';
-		}
-		else
-			str = sep;	/* no more commands for next pass */
+		str = split_token (str);
 #ifdef DEBUG_PARSER
 		printf ("token: \"%s\"\n", token);
 #endif
 
-		/* find macros in this token and replace them */
-		process_macros (token, finaltoken);
-
-		/* Extract arguments */
-		if ((argc = parse_line (finaltoken, argv)) == 0) {
-			rc = -1;	/* no command at all */
-			continue;
-		}
-
-		/* Look up command in command table */
-		if ((cmdtp = find_cmd(argv[0])) == NULL) {
-			printf ("Unknown command '%s' - try 'help'\n", argv[0]);
-			rc = -1;	/* give up after bad command */
-			continue;
-		}
-
-		/* found - check max args */
-		if (argc > cmdtp->maxargs) {
-			cmd_usage(cmdtp);
-			rc = -1;
-			continue;
-		}
-
-#if defined(CONFIG_CMD_BOOTD)
-		/* avoid "bootd" recursion */
-		if (cmdtp->cmd == do_bootd) {
-#ifdef DEBUG_PARSER
-			printf ("[%s]\n", finaltoken);
-#endif
-			if (flag & CMD_FLAG_BOOTD) {
-				puts ("'bootd' recursion detected\n");
-				rc = -1;
-				continue;
-			} else {
-				flag |= CMD_FLAG_BOOTD;
-			}
-		}
-#endif
-
-		/* OK - call function to do the command */
-		if ((cmdtp->cmd) (cmdtp, flag, argc, argv) != 0) {
-			rc = -1;
-		}
-
-		repeatable &= cmdtp->repeatable;
-
-		/* Did the user stop this? */
-		if (had_ctrlc ())
-			return -1;	/* if stopped then not repeatable */
+		ret = run_expanded (token, NULL, 1, &vars, &flag, &repeatable);
+		if (ret == -2)
+			return -1;
+		if (ret)
+			rc = ret;
 	}
 
 	return rc ? rc : repeatable;
@@ -6,42 +6,99 @@
 ******************************************************************************/
 
 #include <common.h>
+#include <command.h>
 #include <watchdog.h>
 #include <asm/errno.h>
 #include <malloc.h>
 
 #include <nand_logif.h>
 
+#include "logif_util.h"
+#include "fit_cache.h"
+
 #ifdef CONFIG_CMD_NAND
 
 /*****************************************************************************/
 /*
- * phyaddress    - NAND partition start address, from this address we count
- *                 bad block. The address should be alignment with block size.
- * logiclength   - The length without bad block. It should be alignment with
- *                 block size.
- *
- * return        - The length with bad block.
+ * The handle we hand out is the head of this structure. The block map is
+ * built once at open time, so the read/write/erase paths do not have to
+ * rescan the bad block table from the partition start on every call.
  */
-static unsigned long long logic_to_phylength(nand_info_t *nand,
-	unsigned long long phyaddress, unsigned long long logiclength)
+struct nand_logic_priv {
+	nand_logic_t logic;        /* MUST be first */
+	unsigned int erase_shift;  /* log2 of the erase block size */
+	unsigned int nr_blocks;    /* physical blocks in the partition */
+	unsigned int nr_good;      /* good blocks in the partition */
+	unsigned int *blockmap;    /* logic block index -> physical index */
+};
+
+#define to_nand_priv(_nand_logic) \
+	((struct nand_logic_priv *)(_nand_logic))
+
+/* max blocks handed to the driver in one streaming read request */
+#define NAND_LOGIC_STREAM_BLOCKS	64
+/* max blocks handed to the driver in one erase request */
+#define NAND_LOGIC_ERASE_BLOCKS		64
+/* min interval of the "Erasing at" progress line, in ms */
+#define NAND_LOGIC_PROGRESS_MS		200
+/*****************************************************************************/
+
+static void nand_logic_build_map(struct nand_logic_priv *priv)
 {
-	unsigned long long len_incl_bad = 0;
-	unsigned long long len_excl_bad = 0;
+	unsigned int ix;
+	nand_info_t *nand = priv->logic.nand;
+	unsigned long long phyaddress = priv->logic.address;
+
+	priv->nr_good = 0;
+	for (ix = 0; ix < priv->nr_blocks; ix++) {
+		WATCHDOG_RESET ();
 
-	while (len_excl_bad < logiclength) {
 		if (!nand_block_isbad(nand, phyaddress))
-			len_excl_bad += nand->erasesize;
+			priv->blockmap[priv->nr_good++] = ix;
+		phyaddress += nand->erasesize;
+	}
+}
+/*****************************************************************************/
+/*
+ * Drop logic block "index" from the map, all following good blocks move
+ * one logic block forward. Called when a block goes bad under us.
+ */
+static void nand_logic_map_remove(struct nand_logic_priv *priv,
+	unsigned int index)
+{
+	if (index >= priv->nr_good)
+		return;
 
-		len_incl_bad += nand->erasesize;
-		phyaddress   += nand->erasesize;
+	memmove(&priv->blockmap[index], &priv->blockmap[index + 1],
+		(priv->nr_good - index - 1) * sizeof(priv->blockmap[0]));
+	priv->nr_good--;
+}
+/*****************************************************************************/
+/*
+ * logiclength   - The length without bad block, counted from the partition
+ *                 start. It should be alignment with block size.
+ *
+ * return        - The length with bad block. If the partition has not
+ *                 enough good blocks, the return value is larger than
+ *                 the partition length.
+ */
+static unsigned long long logic_to_phylength(nand_logic_t *nand_logic,
+	unsigned long long logiclength)
+{
+	struct nand_logic_priv *priv = to_nand_priv(nand_logic);
+	unsigned long long nr_logic;
 
-		if (phyaddress >= nand->size) {
-			printf("Out of nand flash range.\n");
-			break;
-		}
-	}
-	return len_incl_bad;
+	nr_logic = (logiclength + nand_logic->erasesize - 1)
+		>> priv->erase_shift;
+	if (!nr_logic)
+		return 0;
+
+	if (nr_logic > priv->nr_good)
+		return (unsigned long long)(priv->nr_blocks
+			+ (nr_logic - priv->nr_good)) * nand_logic->erasesize;
+
+	return (unsigned long long)(priv->blockmap[nr_logic - 1] + 1)
+		* nand_logic->erasesize;
 }
 /*****************************************************************************/
 /*
@@ -56,6 +113,7 @@ nand_logic_t *nand_logic_open(unsigned long long address,
 {
 	nand_info_t  *nand;
 	nand_logic_t *nand_logic;
+	struct nand_logic_priv *priv;
 
 	/* the following commands operate on the current device */
 	if (nand_curr_device < 0
@@ -86,23 +144,46 @@ nand_logic_t *nand_logic_open(unsigned long long address,
 		return NULL;
 	}
 
-	if ((nand_logic = malloc(sizeof(nand_logic_t))) == NULL) {
+	if ((priv = malloc(sizeof(struct nand_logic_priv))) == NULL) {
+		printf("Out of memory.\n");
+		return NULL;
+	}
+
+	/* erasesize is a power of 2, avoid 64 bit division */
+	priv->erase_shift = 0;
+	while ((1U << priv->erase_shift) < nand->erasesize)
+		priv->erase_shift++;
+
+	priv->nr_blocks = (unsigned int)(length >> priv->erase_shift);
+	priv->blockmap = malloc((priv->nr_blocks ? priv->nr_blocks : 1)
+		* sizeof(priv->blockmap[0]));
+	if (priv->blockmap == NULL) {
 		printf("Out of memory.\n");
+		free(priv);
 		return NULL;
 	}
 
+	nand_logic = &priv->logic;
 	nand_logic->nand      = nand;
 	nand_logic->address   = address;
 	nand_logic->length    = length;
 	nand_logic->erasesize = nand->erasesize;
 
+	nand_logic_build_map(priv);
+
 	return nand_logic;
 }
 /*****************************************************************************/
 
 void nand_logic_close(nand_logic_t *nand_logic)
 {
-	free(nand_logic);
+	struct nand_logic_priv *priv = to_nand_priv(nand_logic);
+
+	if (!nand_logic)
+		return;
+
+	free(priv->blockmap);
+	free(priv);
 }
 /*****************************************************************************/
 /*
@@ -122,7 +203,12 @@ int nand_logic_erase(nand_logic_t *nand_logic, unsigned long long offset,
 {
 	struct erase_info erase;
 	unsigned long long phylength;
+	unsigned int logic_block;
+	unsigned int phy_block;
+	unsigned int single_until;
+	unsigned long progress;
 	nand_info_t *nand = nand_logic->nand;
+	struct nand_logic_priv *priv = to_nand_priv(nand_logic);
 
 	if ((offset & (nand->erasesize - 1))
 		|| (length & (nand->erasesize - 1))) {
@@ -133,8 +219,7 @@ int nand_logic_erase(nand_logic_t *nand_logic, unsigned long long offset,
 		return -1;
 	}
 
-	phylength = logic_to_phylength(nand,
-		nand_logic->address, (offset + length));
+	phylength = logic_to_phylength(nand_logic, (offset + length));
 	/*
 	 * If the erase real length (phylength) out of paratition,
 	 * we only erase the paratition length. We are not check the phylength
@@ -151,36 +236,69 @@ int nand_logic_erase(nand_logic_t *nand_logic, unsigned long long offset,
 		return -1;
 	}
 
-	phylength = logic_to_phylength(nand, nand_logic->address, offset);
+	fit_cache_note_write("nand", nand_logic->address + offset, length);
+
+	phylength = logic_to_phylength(nand_logic, offset);
 
 	memset(&erase, 0, sizeof(erase));
 	erase.mtd  = nand;
-	erase.len  = nand->erasesize;
 	erase.addr = nand_logic->address + phylength;
 
-	for (; length > 0; erase.addr += nand->erasesize) {
+	/*
+	 * Walk the physical blocks, the block map tells us which are good:
+	 * a block is good only if it is the next entry of the map.
+	 * Runs of contiguous good blocks go to the driver in one request.
+	 */
+	logic_block = (unsigned int)(offset >> priv->erase_shift);
+	phy_block = (unsigned int)(phylength >> priv->erase_shift);
+	single_until = phy_block;
+	progress = get_timer(0) - NAND_LOGIC_PROGRESS_MS;
+
+	while (length > 0) {
+		int ret;
+		int markbad = 0;
+		unsigned int nr_blocks = 1;
+
 		WATCHDOG_RESET ();
 
 		if (erase.addr >= (nand_logic->address + nand_logic->length))
 			break;
 
-		int ret = nand->block_isbad (nand, erase.addr);
-		if (ret > 0) {
+		if (logic_block >= priv->nr_good
+			|| priv->blockmap[logic_block] != phy_block) {
 			printf("\rSkipping bad block at  "
 				"0x%08llx                   "
 				"                         \n",
 				erase.addr);
+			erase.addr += nand->erasesize;
+			phy_block++;
 			continue;
-		} else if (ret < 0) {
-			printf("\n%s: MTD get bad block at 0x%08llx"
-				" failed: %d\n",
-				nand->name, erase.addr, ret);
-			return -1;
 		}
 
-		printf("\rErasing at 0x%08llx", erase.addr);
-		if ((ret = nand->erase(nand, &erase)) != 0) {
+		while (phy_block >= single_until
+			&& nr_blocks < NAND_LOGIC_ERASE_BLOCKS
+			&& ((unsigned long long)(nr_blocks + 1)
+				<< priv->erase_shift) <= length
+			&& (logic_block + nr_blocks) < priv->nr_good
+			&& priv->blockmap[logic_block + nr_blocks]
+				== (phy_block + nr_blocks))
+			nr_blocks++;
+		erase.len = (unsigned long long)nr_blocks << priv->erase_shift;
+
+		if (erase.len == length
+			|| get_timer(progress) >= NAND_LOGIC_PROGRESS_MS) {
+			printf("\rErasing at 0x%08llx", erase.addr);
+			progress = get_timer(0);
+		}
 
+		ret = nand->erase(nand, &erase);
+		if (ret && nr_blocks > 1) {
+			/* erase this run again block by block to find the failed one */
+			single_until = phy_block + nr_blocks;
+			continue;
+		}
+
+		if (ret) {
 			printf("\n%s: MTD Erase at 0x%08llx failure: %d, ",
 				nand->name, erase.addr, ret);
 
@@ -191,15 +309,26 @@ int nand_logic_erase(nand_logic_t *nand_logic, unsigned long long offset,
 					printf("\n%s: MTD block_markbad at"
 						" 0x%08llx failed: %d, aborting\n",
 						nand->name, erase.addr, ret);
+					fit_cache_note_done();
 					return -1;
 				}
+				markbad = 1;
 			}
 			printf("\n");
 		}
 
-		length -= nand->erasesize;
+		/* a new bad block hands its logic index to the next good one */
+		if (markbad)
+			nand_logic_map_remove(priv, logic_block);
+		else
+			logic_block += nr_blocks;
+
+		erase.addr += erase.len;
+		phy_block  += nr_blocks;
+		length     -= erase.len;
 	}
 	printf("\n");
+	fit_cache_note_done();
 	return 0;
 }
 /*****************************************************************************/
@@ -232,6 +361,7 @@ int nand_logic_write(nand_logic_t *nand_logic, unsigned long long offset,
 	unsigned long long phylength;
 	unsigned long long phyaddress;
 	nand_info_t *nand = nand_logic->nand;
+	int ret;
 
 	/* Reject write, which are not page aligned */
 	if ((offset & (nand->writesize - 1))
@@ -253,7 +383,7 @@ int nand_logic_write(nand_logic_t *nand_logic, unsigned long long offset,
 	 * read/write first block is bad block, so we can't meet this uboot
 	 * restrict.
 	 */
-	phylength = logic_to_phylength(nand, nand_logic->address,
+	phylength = logic_to_phylength(nand_logic,
 		(offset + length + nand->erasesize - 1)
 			& (~(nand_logic->erasesize - 1)));
 	if ((offset > nand_logic->length)
@@ -266,7 +396,9 @@ int nand_logic_write(nand_logic_t *nand_logic, unsigned long long offset,
 		return -1;
 	}
 
-	phylength = logic_to_phylength(nand, nand_logic->address,
+	fit_cache_note_write("nand", nand_logic->address + offset, length);
+
+	phylength = logic_to_phylength(nand_logic,
 		(offset + nand->erasesize - 1) & (~(nand_logic->erasesize - 1)));
 	if (offset & (nand_logic->erasesize - 1)) {
 		phyaddress = phylength - nand->erasesize
@@ -279,13 +411,151 @@ int nand_logic_write(nand_logic_t *nand_logic, unsigned long long offset,
 	if (withoob) {
 		length = length / nand->writesize
 			* (nand->writesize + nand->oobsize);
-		return nand_write_yaffs_skip_bad(nand_logic->nand,
+		ret = nand_write_yaffs_skip_bad(nand_logic->nand,
 			phyaddress, &length, buf);
 	} else {
-		return nand_write_skip_bad(nand_logic->nand,
+		ret = nand_write_skip_bad(nand_logic->nand,
 			phyaddress, &length, buf);
 	}
+	fit_cache_note_done();
+	return ret;
+}
+/*****************************************************************************/
+#if defined(CONFIG_NAND_LOGIC_PAGE_READ) || defined(CONFIG_CMD_NAND_LOGIC_BENCH)
+/*
+ * Read yaffs2 data page by page, one read_oob() per page.
+ *
+ * phyaddress - NAND physical start address, the first block is good.
+ */
+static int nand_logic_read_oob_page(nand_logic_t *nand_logic,
+	unsigned long long phyaddress, unsigned int length, unsigned char *buf)
+{
+	nand_info_t *nand = nand_logic->nand;
+	unsigned long long block_offset;
+	unsigned long long read_length;
+
+	while (length > 0) {
+		block_offset = phyaddress & (nand->erasesize - 1);
+
+		WATCHDOG_RESET ();
+
+		if (nand_block_isbad (nand, phyaddress
+			& ~(nand_logic->erasesize - 1))) {
+			printf("Skipping bad block 0x%08llx\n",
+				phyaddress & ~(nand_logic->erasesize - 1));
+			phyaddress += nand->erasesize - block_offset;
+			continue;
+		}
+
+		if (length < (nand->erasesize - block_offset))
+			read_length = length;
+		else
+			read_length = nand->erasesize - block_offset;
+
+		while (read_length > 0) {
+			int ret;
+			struct mtd_oob_ops ops;
+
+			memset(&ops, 0, sizeof(ops));
+			ops.datbuf = buf;
+			ops.oobbuf = buf + nand->writesize;
+			ops.len = nand->writesize;
+			ops.ooblen = nand->oobsize;
+			ops.mode = MTD_OOB_RAW;
+
+			ret = nand->read_oob(nand, phyaddress, &ops);
+			if (ret < 0) {
+				printf("Error (%d) reading page"
+					" 0x%08llx\n",
+					ret, phyaddress);
+				return -1;
+			}
+			phyaddress  += nand->writesize;
+			read_length -= nand->writesize;
+			length      -= nand->writesize;
+			buf += nand->writesize + nand->oobsize;
+		}
+	}
+	return 0;
+}
+#endif
+/*****************************************************************************/
+#if !defined(CONFIG_NAND_LOGIC_PAGE_READ) || defined(CONFIG_CMD_NAND_LOGIC_BENCH)
+/*
+ * Read yaffs2 data by runs of physically contiguous good blocks. Each run
+ * is one MTD_OOB_RAW request, the driver lays the pages out in the buffer
+ * as data:oob:data:oob, which is the yaffs2 image layout. Bad blocks are
+ * known from the block map, so they are never probed here.
+ *
+ * offset - NAND read logic start address, page aligned and inside the
+ *          handle, checked by the caller.
+ */
+static int nand_logic_read_oob_stream(nand_logic_t *nand_logic,
+	unsigned long long offset, unsigned int length, unsigned char *buf)
+{
+	struct nand_logic_priv *priv = to_nand_priv(nand_logic);
+	nand_info_t *nand = nand_logic->nand;
+	unsigned int logic_block;
+	unsigned int block_offset;
+
+	logic_block  = (unsigned int)(offset >> priv->erase_shift);
+	block_offset = (unsigned int)(offset & (nand->erasesize - 1));
+
+	while (length > 0) {
+		int ret;
+		struct mtd_oob_ops ops;
+		unsigned long long phyaddress;
+		unsigned int first_block;
+		unsigned int nr_blocks = 1;
+		unsigned int read_length;
+
+		WATCHDOG_RESET ();
+
+		if (logic_block >= priv->nr_good) {
+			printf("Out of nand flash range.\n");
+			return -1;
+		}
+		first_block = priv->blockmap[logic_block];
+
+		read_length = nand->erasesize - block_offset;
+		while (read_length < length
+			&& nr_blocks < NAND_LOGIC_STREAM_BLOCKS
+			&& (logic_block + nr_blocks) < priv->nr_good
+			&& priv->blockmap[logic_block + nr_blocks]
+				== (first_block + nr_blocks)) {
+			read_length += nand->erasesize;
+			nr_blocks++;
+		}
+		if (read_length > length)
+			read_length = length;
+
+		phyaddress = nand_logic->address
+			+ ((unsigned long long)first_block << priv->erase_shift)
+			+ block_offset;
+
+		memset(&ops, 0, sizeof(ops));
+		ops.datbuf = buf;
+		ops.oobbuf = buf + nand->writesize;
+		ops.len = read_length;
+		ops.ooblen = (read_length / nand->writesize) * nand->oobsize;
+		ops.mode = MTD_OOB_RAW;
+
+		ret = nand->read_oob(nand, phyaddress, &ops);
+		if (ret < 0) {
+			printf("Error (%d) reading page 0x%08llx\n",
+				ret, phyaddress);
+			return -1;
+		}
+
+		buf += (read_length / nand->writesize)
+			* (nand->writesize + nand->oobsize);
+		length -= read_length;
+		logic_block += nr_blocks;
+		block_offset = 0;
+	}
+	return 0;
 }
+#endif
 /*****************************************************************************/
 /*
  * offset  - NAND read logic start address. You don't case bad block.
@@ -316,6 +586,7 @@ int nand_logic_read(nand_logic_t *nand_logic, unsigned long long offset,
 	unsigned long long phylength;
 	unsigned long long phyaddress;
 	nand_info_t *nand = nand_logic->nand;
+	int ret;
 
 	/* Reject read, which are not page aligned */
 	if ((offset & (nand->writesize - 1))
@@ -337,7 +608,7 @@ int nand_logic_read(nand_logic_t *nand_logic, unsigned long long offset,
 	 * read/write first block is bad block, so we can't meet this uboot
 	 * restrict.
 	 */
-	phylength = logic_to_phylength(nand, nand_logic->address,
+	phylength = logic_to_phylength(nand_logic,
 		(offset + length + nand->erasesize - 1)
 			& (~(nand_logic->erasesize - 1)));
 	if ((offset > nand_logic->length)
@@ -350,7 +621,7 @@ int nand_logic_read(nand_logic_t *nand_logic, unsigned long long offset,
 		return -1;
 	}
 
-	phylength = logic_to_phylength(nand, nand_logic->address,
+	phylength = logic_to_phylength(nand_logic,
 		(offset + nand->erasesize - 1) & (~(nand_logic->erasesize - 1)));
 	if (offset & (nand_logic->erasesize - 1))
 		phyaddress = phylength - nand->erasesize +
@@ -359,56 +630,233 @@ int nand_logic_read(nand_logic_t *nand_logic, unsigned long long offset,
 		phyaddress = phylength + nand_logic->address;
 
 	if (withoob) {
-		unsigned long long block_offset;
-		unsigned long long read_length;
+#ifdef CONFIG_NAND_LOGIC_PAGE_READ
+		return nand_logic_read_oob_page(nand_logic, phyaddress,
+			length, buf);
+#else
+		return nand_logic_read_oob_stream(nand_logic, offset,
+			length, buf);
+#endif
+	} else {
+		ret = nand_read_skip_bad(nand, phyaddress, &length, buf);
+		if (!ret)
+			fit_cache_note_read("nand",
+				nand_logic->address + offset, buf, length);
+		return ret;
+	}
+}
+/*****************************************************************************/
+/*
+ * Differential program, erase and write only the blocks which changed.
+ *
+ * offset  - NAND logic start address. You don't case bad block.
+ *           It should be alignment with NAND block size.
+ * length  - NAND logic length to program. You don't case bad block.
+ *           It should be alignment with NAND block size.
+ * buf     - new data, without oob.
+ * buflen  - new data length, page aligned, no more than length. The range
+ *           after buflen should be left erased.
+ *
+ * return  - 0: success.
+ *           other: fail.
+ * NOTES:
+ *    Each block is read back and compared with the new data. Blocks with
+ *    the same content, and erased blocks which should stay erased, are
+ *    skipped. If a block goes bad, the following data moves to other
+ *    physical blocks, so all the rest blocks are erased and written.
+ *    yaffs2 (withoob) images are not supported, the raw oob read back
+ *    includes ECC bytes and never matches the image.
+ */
+int nand_logic_write_diff(nand_logic_t *nand_logic, unsigned long long offset,
+	unsigned long long length, unsigned char *buf, unsigned int buflen)
+{
+	struct nand_logic_priv *priv = to_nand_priv(nand_logic);
+	nand_info_t *nand = nand_logic->nand;
+	unsigned long long phylength;
+	unsigned char *readbuf;
+	unsigned int nr_good;
+	unsigned int nr_blocks = 0;
+	unsigned int nr_skip = 0;
+	int full = 0;
+	int ret = 0;
 
-		while (length > 0) {
-			block_offset = phyaddress & (nand->erasesize - 1);
+	if ((offset & (nand->erasesize - 1))
+		|| (length & (nand->erasesize - 1))
+		|| (buflen & (nand->writesize - 1))
+		|| (buflen > length)) {
+		printf("Attempt to program non aligned data, "
+			"nand blocksize: 0x%08x, offset: 0x%08llx,"
+			" length: 0x%08llx, data length: 0x%08x\n",
+			nand->erasesize, offset, length, buflen);
+		return -1;
+	}
 
-			WATCHDOG_RESET ();
+	phylength = logic_to_phylength(nand_logic, offset + length);
+	if ((offset > nand_logic->length)
+		|| (length > nand_logic->length)
+		|| (phylength > nand_logic->length)) {
+		printf("Attempt to program outside the flash handle area, "
+			"flash handle size: 0x%08llx, offset: 0x%08llx, "
+			"length: 0x%08llx, phylength:  0x%08llx\n",
+			nand_logic->length, offset, length, phylength);
+		return -1;
+	}
 
-			if (nand_block_isbad (nand, phyaddress
-				& ~(nand_logic->erasesize - 1))) {
-				printf("Skipping bad block 0x%08llx\n",
-					phyaddress & ~(nand_logic->erasesize - 1));
-				phyaddress += nand->erasesize - block_offset;
-				continue;
-			}
+	if ((readbuf = malloc(nand->erasesize)) == NULL) {
+		printf("Out of memory.\n");
+		return -1;
+	}
 
-			if (length < (nand->erasesize - block_offset))
-				read_length = length;
-			else
-				read_length = nand->erasesize - block_offset;
+	while (length > 0) {
+		unsigned int datalen;
 
-			while (read_length > 0) {
-				int ret;
-				struct mtd_oob_ops ops;
+		WATCHDOG_RESET ();
 
-				memset(&ops, 0, sizeof(ops));
-				ops.datbuf = buf;
-				ops.oobbuf = buf + nand->writesize;
-				ops.len = nand->writesize;
-				ops.ooblen = nand->oobsize;
-				ops.mode = MTD_OOB_RAW;
+		datalen = (buflen > nand->erasesize) ? nand->erasesize : buflen;
 
-				ret = nand->read_oob(nand, phyaddress, &ops);
-				if (ret < 0) {
-					printf("Error (%d) reading page"
-						" 0x%08llx\n",
-						ret, phyaddress);
-					return -1;
-				}
-				phyaddress  += nand->writesize;
-				read_length -= nand->writesize;
-				length      -= nand->writesize;
-				buf += nand->writesize + nand->oobsize;
+		if (!full) {
+			if (!nand_logic_read(nand_logic, offset,
+				nand->erasesize, readbuf, 0)
+				&& !memcmp(readbuf, buf, datalen)
+				&& logic_is_erased(readbuf + datalen,
+					nand->erasesize - datalen)) {
+				nr_skip++;
+				goto next;
 			}
 		}
-		return 0;
-	} else {
-		return nand_read_skip_bad(nand, phyaddress, &length, buf);
+
+		nr_good = priv->nr_good;
+		if (nand_logic_erase(nand_logic, offset, nand->erasesize)) {
+			ret = -1;
+			break;
+		}
+		if (nr_good != priv->nr_good) {
+			/* block went bad, program this logic block again */
+			full = 1;
+			continue;
+		}
+
+		if (datalen && !logic_is_erased(buf, datalen)
+			&& nand_logic_write(nand_logic, offset, datalen, buf, 0)) {
+			ret = -1;
+			break;
+		}
+next:
+		nr_blocks++;
+		offset += nand->erasesize;
+		length -= nand->erasesize;
+		buf    += datalen;
+		buflen -= datalen;
+	}
+
+	free(readbuf);
+	printf("Program %u blocks, %u unchanged blocks skipped\n",
+		nr_blocks, nr_skip);
+	return ret;
+}
+/*****************************************************************************/
+#ifdef CONFIG_CMD_NAND_LOGIC_BENCH
+
+static void nand_logic_bench_report(const char *name, unsigned int length,
+	unsigned long ms)
+{
+	unsigned long kbps;
+
+	if (!ms)
+		ms = 1;
+	kbps = (unsigned long)(length >> 10) * 1000 / ms;
+
+	printf("%-8s: 0x%08x bytes in %lu ms, %lu.%02lu MB/s\n",
+		name, length, ms, kbps >> 10, ((kbps & 1023) * 100) >> 10);
+}
+/*****************************************************************************/
+
+int do_nand_logic_bench(cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	nand_logic_t *nand_logic;
+	unsigned long long address;
+	unsigned long long length;
+	unsigned long long phylength;
+	unsigned int size;
+	unsigned int buflen;
+	unsigned char *buf_page;
+	unsigned char *buf_stream;
+	unsigned long start;
+	unsigned long ms_page;
+	unsigned long ms_stream;
+	nand_info_t *nand;
+	int ret;
+
+	if (argc < 5) {
+		cmd_usage(cmdtp);
+		return 1;
+	}
+
+	address = simple_strtoull(argv[1], NULL, 16);
+	length  = simple_strtoull(argv[2], NULL, 16);
+	size    = simple_strtoul(argv[3], NULL, 16);
+	buf_page = (unsigned char *)simple_strtoul(argv[4], NULL, 16);
+
+	nand_logic = nand_logic_open(address, length);
+	if (!nand_logic)
+		return 1;
+	nand = nand_logic->nand;
+
+	if (!size || (size & (nand->writesize - 1))) {
+		printf("Size should be alignment with page size 0x%08x\n",
+			nand->writesize);
+		nand_logic_close(nand_logic);
+		return 1;
+	}
+
+	phylength = logic_to_phylength(nand_logic, size);
+	if (phylength > nand_logic->length) {
+		printf("Attempt to read outside the flash handle area, "
+			"flash handle size: 0x%08llx, length: 0x%08x\n",
+			nand_logic->length, size);
+		nand_logic_close(nand_logic);
+		return 1;
+	}
+
+	buflen = size / nand->writesize * (nand->writesize + nand->oobsize);
+	buf_stream = buf_page + buflen;
+
+	start = get_timer(0);
+	ret = nand_logic_read_oob_page(nand_logic, nand_logic->address,
+		size, buf_page);
+	ms_page = get_timer(start);
+	if (ret) {
+		nand_logic_close(nand_logic);
+		return 1;
+	}
+
+	start = get_timer(0);
+	ret = nand_logic_read_oob_stream(nand_logic, 0, size, buf_stream);
+	ms_stream = get_timer(start);
+	nand_logic_close(nand_logic);
+	if (ret)
+		return 1;
+
+	nand_logic_bench_report("page", size, ms_page);
+	nand_logic_bench_report("stream", size, ms_stream);
+
+	if (memcmp(buf_page, buf_stream, buflen)) {
+		printf("Data mismatch between page and stream read.\n");
+		return 1;
 	}
+	return 0;
 }
+
+U_BOOT_CMD(
+	nandlbench, 5, 0, do_nand_logic_bench,
+	"benchmark NAND logic partition raw (yaffs2) read",
+	"address length size memaddr\n"
+	"    - read 'size' bytes with oob from the start of the partition\n"
+	"      at 'address'/'length', page by page and streaming, and\n"
+	"      report MB/s. Needs 2 * size * (page + oob) / page bytes\n"
+	"      of RAM at 'memaddr'."
+);
+#endif /* CONFIG_CMD_NAND_LOGIC_BENCH */
 /*****************************************************************************/
 
 #endif /* CONFIG_CMD_NAND */
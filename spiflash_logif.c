@@ -5,11 +5,22 @@
 *
 ******************************************************************************/
 #include <common.h>
+#include <watchdog.h>
 #include <malloc.h>
 #include <linux/mtd/mtd.h>
 
 #include <spiflash_logif.h>
 
+#include "logif_util.h"
+#include "fit_cache.h"
+
+/*****************************************************************************/
+
+/* the 64KiB block erase most SPI NOR parts support besides sector erase */
+#define SPIFLASH_BLOCK_SIZE		0x10000
+/* min interval of the "Erasing at" progress line, in ms */
+#define SPIFLASH_PROGRESS_MS		200
+
 /*****************************************************************************/
 
 spiflash_logic_t *spiflash_logic_open(unsigned long long address, unsigned long long length)
@@ -82,6 +93,7 @@ int spiflash_logic_erase
  )
 {
 	unsigned long blocksize, eraseoffset, eraselen;
+	unsigned long erasesize, progress;
 
 	/* Reject write, which are not block aligned */
 	if ((offset & (spiflash_logic->erasesize - 1)) || (length & (spiflash_logic->erasesize - 1)))
@@ -103,25 +115,48 @@ int spiflash_logic_erase
 		return -1;
 	}
 
+	fit_cache_note_write("sf", spiflash_logic->address + offset, length);
+
 	blocksize   = spiflash_logic->erasesize;
 	eraselen    = length;
 	eraseoffset = spiflash_logic->address + offset;
+	progress    = get_timer(0) - SPIFLASH_PROGRESS_MS;
 
 	/* eraselen MUST align with blocksize here */
 	while (eraselen > 0) {
 		int ret;
-		printf("\rErasing at 0x%lx", eraseoffset);
+
+		if (!eraseoffset
+			&& eraselen == spiflash_logic->spiflash->size) {
+			/* whole chip in one request, driver may use chip erase */
+			erasesize = eraselen;
+		} else if (blocksize < SPIFLASH_BLOCK_SIZE
+			&& !(eraseoffset & (SPIFLASH_BLOCK_SIZE - 1))
+			&& eraselen >= SPIFLASH_BLOCK_SIZE) {
+			/* group small sectors into one 64KiB block erase */
+			erasesize = SPIFLASH_BLOCK_SIZE;
+		} else {
+			erasesize = blocksize;
+		}
+
+		if (erasesize == eraselen
+			|| get_timer(progress) >= SPIFLASH_PROGRESS_MS) {
+			printf("\rErasing at 0x%lx", eraseoffset);
+			progress = get_timer(0);
+		}
 		ret = spi_flash_erase(spiflash_logic->spiflash,
-			eraseoffset, blocksize);
+			eraseoffset, erasesize);
 		if (ret) {
 			printf("\nSPI Flash Erasing at 0x%lx failed\n",
 				eraseoffset);
+			fit_cache_note_done();
 			return -1;
 		}
-		eraselen    -= blocksize;
-		eraseoffset += blocksize;
+		eraselen    -= erasesize;
+		eraseoffset += erasesize;
 	}
 	printf("\n");
+	fit_cache_note_done();
 
 	return 0;
 }
@@ -135,6 +170,8 @@ int spiflash_logic_write
  unsigned char *buf
  )
 {
+	int ret;
+
 	if ((offset > spiflash_logic->length)
 		|| (length > spiflash_logic->length)
 		|| ((offset + length) > spiflash_logic->length))
@@ -145,8 +182,11 @@ int spiflash_logic_write
 			spiflash_logic->length, offset, length, offset + length);
 		return -1;
 	}
-	
-	return spi_flash_write(spiflash_logic->spiflash, spiflash_logic->address + offset, length, buf);
+
+	fit_cache_note_write("sf", spiflash_logic->address + offset, length);
+	ret = spi_flash_write(spiflash_logic->spiflash, spiflash_logic->address + offset, length, buf);
+	fit_cache_note_done();
+	return ret;
 }
 /*****************************************************************************/
 
@@ -168,7 +208,112 @@ int spiflash_logic_read
 			spiflash_logic->length, offset, length, offset + length);
 		return -1;
 	}
-	
-	return spi_flash_read(spiflash_logic->spiflash, spiflash_logic->address + offset, length, buf);
+
+	if (spi_flash_read(spiflash_logic->spiflash, spiflash_logic->address + offset, length, buf))
+		return -1;
+	fit_cache_note_read("sf", spiflash_logic->address + offset, buf, length);
+	return 0;
+}
+/*****************************************************************************/
+/*
+ * Differential program, erase and write only the blocks which changed.
+ * Blocks with the same content, and erased blocks which should stay
+ * erased, are skipped. The range after buflen should be left erased.
+ */
+int spiflash_logic_write_diff
+(
+ spiflash_logic_t *spiflash_logic,
+ unsigned long long offset,   /* should be alignment with spi flash block size */
+ unsigned long long length,   /* should be alignment with spi flash block size */
+ unsigned char *buf,
+ unsigned int buflen          /* new data length, no more than length */
+ )
+{
+	unsigned long blocksize, address;
+	unsigned int nr_blocks = 0, nr_skip = 0;
+	unsigned char *readbuf;
+	int ret = 0;
+
+	if ((offset & (spiflash_logic->erasesize - 1))
+		|| (length & (spiflash_logic->erasesize - 1))
+		|| (buflen > length))
+	{
+		printf("Attempt to program non block aligned data, "
+			"spi flash blocksize: 0x%08llx, offset: 0x%08llx, "
+			"length: 0x%08llx, data length: 0x%08x\n",
+			spiflash_logic->erasesize, offset, length, buflen);
+		return -1;
+	}
+
+	if ((offset > spiflash_logic->length)
+		|| (length > spiflash_logic->length)
+		|| ((offset + length) > spiflash_logic->length))
+	{
+		printf("Attempt to program outside the flash handle area, "
+			"flash handle size: 0x%08llx, offset: 0x%08llx, "
+			"length: 0x%08llx, phylength:  0x%08llx\n",
+			spiflash_logic->length, offset, length, offset + length);
+		return -1;
+	}
+
+	fit_cache_note_write("sf", spiflash_logic->address + offset, length);
+
+	blocksize = spiflash_logic->erasesize;
+	address   = spiflash_logic->address + offset;
+
+	if ((readbuf = malloc(blocksize)) == NULL)
+	{
+		printf("no many memory.\n");
+		fit_cache_note_done();
+		return -1;
+	}
+
+	for (; length > 0; length -= blocksize, address += blocksize)
+	{
+		unsigned int datalen;
+
+		WATCHDOG_RESET();
+
+		datalen = (buflen > blocksize) ? blocksize : buflen;
+
+		if (!spi_flash_read(spiflash_logic->spiflash, address,
+				blocksize, readbuf)
+			&& !memcmp(readbuf, buf, datalen)
+			&& logic_is_erased(readbuf + datalen,
+				blocksize - datalen))
+		{
+			nr_skip++;
+		}
+		else
+		{
+			printf("\rErasing at 0x%lx", address);
+			if (spi_flash_erase(spiflash_logic->spiflash,
+				address, blocksize))
+			{
+				printf("\nSPI Flash Erasing at 0x%lx failed\n",
+					address);
+				ret = -1;
+				break;
+			}
+
+			if (datalen && !logic_is_erased(buf, datalen)
+				&& spi_flash_write(spiflash_logic->spiflash,
+					address, datalen, buf))
+			{
+				ret = -1;
+				break;
+			}
+		}
+
+		nr_blocks++;
+		buf    += datalen;
+		buflen -= datalen;
+	}
+	free(readbuf);
+	fit_cache_note_done();
+
+	printf("\nProgram %u blocks, %u unchanged blocks skipped\n",
+		nr_blocks, nr_skip);
+	return ret;
 }
 /*****************************************************************************/
@@ -0,0 +1,115 @@
+/*
+ * Host test of crc16_ccitt() (crc16_ccitt.c, slice-by-8) against the
+ * byte-at-a-time calc_crc16() the download paths used before: known
+ * vectors, random buffers at every alignment with lengths 0..64 and some
+ * longer ones, and the short ones updated in two calls split at every
+ * point.
+ *
+ *   ./run.sh
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern unsigned short crc16_ccitt(unsigned short crc,
+	const unsigned char *buf, unsigned int length);
+
+static unsigned short crc16_table[256];
+
+static int failed;
+
+#define CHECK(cond, what, align, len) do { \
+	if (!(cond)) { \
+		printf("FAIL %s: align %u, length %u\n", what, align, len); \
+		failed++; \
+	} \
+} while (0)
+
+/* the table of the old code, made bit by bit here */
+static void make_table(void)
+{
+	unsigned int x, bit;
+
+	for (x = 0; x < 256; x++) {
+		unsigned short crc = x << 8;
+
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		crc16_table[x] = crc;
+	}
+}
+
+/* as it was in download_process.c, message followed by two zero bytes */
+static unsigned short calc_crc16(unsigned char *packet, unsigned long length)
+{
+	unsigned short crc16 = 0;
+	unsigned long i;
+
+	for (i = 0; i < length; i++)
+		crc16 = ((crc16 << 8) | packet[i]) ^ crc16_table[(crc16 >> 8) & 0xFF];
+
+	for (i = 0; i < 2; i++)
+		crc16 = ((crc16 << 8) | 0) ^ crc16_table[(crc16 >> 8) & 0xFF];
+
+	return crc16;
+}
+
+static void test_vectors(void)
+{
+	static unsigned char check[] = "123456789";
+	static unsigned char head[] = { 0xAB, 0x00, 0x10 };
+
+	CHECK(crc16_ccitt(0, check, 0) == 0, "empty", 0, 0);
+	/* CRC-16/XMODEM check value */
+	CHECK(crc16_ccitt(0, check, 9) == 0x31C3, "123456789", 0, 9);
+	CHECK(calc_crc16(check, 9) == 0x31C3, "old 123456789", 0, 9);
+	CHECK(crc16_ccitt(0, head, 3) == calc_crc16(head, 3), "head", 0, 3);
+}
+
+/* one buffer per case, exact size, so ASan sees reads past the end */
+static void test_random(unsigned int align, unsigned int len)
+{
+	unsigned char *mem = malloc(align + len + 1);
+	unsigned char *buf = mem + align;
+	unsigned short crc, old;
+	unsigned int ix, cut;
+
+	for (ix = 0; ix < len; ix++)
+		buf[ix] = rand();
+
+	old = calc_crc16(buf, len);
+	crc = crc16_ccitt(0, buf, len);
+	CHECK(crc == old, "random", align, len);
+
+	for (cut = 0; len <= 64 && cut <= len; cut++) {
+		unsigned short part = crc16_ccitt(0, buf, cut);
+
+		part = crc16_ccitt(part, buf + cut, len - cut);
+		CHECK(part == old, "split", align, len);
+	}
+
+	free(mem);
+}
+
+int main(void)
+{
+	static const unsigned int longer[] = { 255, 1024, 4097, 65535 };
+	unsigned int align, len, n;
+
+	make_table();
+	srand(1);
+
+	test_vectors();
+
+	for (align = 0; align < 8; align++)
+		for (len = 0; len <= 64; len++)
+			for (n = 0; n < 16; n++)
+				test_random(align, len);
+
+	for (n = 0; n < sizeof(longer) / sizeof(longer[0]); n++)
+		for (align = 0; align < 8; align++)
+			test_random(align, longer[n]);
+
+	printf("crc16: %s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}
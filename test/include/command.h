@@ -0,0 +1,9 @@
+/*
+ * <command.h> for the host tests, the commands themselves are not built.
+ */
+#ifndef __TEST_COMMAND_H__
+#define __TEST_COMMAND_H__
+
+typedef struct cmd_tbl_s cmd_tbl_t;
+
+#endif /* __TEST_COMMAND_H__ */
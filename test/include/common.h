@@ -0,0 +1,18 @@
+/*
+ * The bits of <common.h> the pure functions under test use, so that they
+ * build on the host. Not for code that touches the hardware.
+ */
+#ifndef __TEST_COMMON_H__
+#define __TEST_COMMON_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t		u8;
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+typedef unsigned char	uchar;
+typedef unsigned long	ulong;
+
+#endif /* __TEST_COMMON_H__ */
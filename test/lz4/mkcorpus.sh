@@ -0,0 +1,23 @@
+#!/bin/sh
+# Make the lz4 test corpus with the lz4 tool, run in this directory.
+# Each <name>.raw is compressed in every mode ulz4fn() has to handle.
+set -e
+
+python3 - <<'PY'
+import random
+random.seed(1)
+open('empty.raw', 'wb').close()
+open('zeros.raw', 'wb').write(bytes(65536))
+open('random.raw', 'wb').write(bytes(random.getrandbits(8) for _ in range(4096)))
+words = [b'nand', b'emmc', b'bootm', b'kernel', b'0x', b'setenv', b' ', b'\n']
+open('text.raw', 'wb').write(b''.join(random.choice(words) for _ in range(20000)))
+PY
+
+for raw in *.raw; do
+	name=${raw%.raw}
+	lz4 -q -f              $raw $name.lz4
+	lz4 -q -f -l           $raw $name.legacy.lz4
+	lz4 -q -f -9 -BD       $raw $name.linked.lz4
+	lz4 -q -f -B4 -BX --content-size $raw $name.checksum.lz4
+	lz4 -q -f --no-frame-crc $raw $name.nocrc.lz4
+done
@@ -0,0 +1,120 @@
+/*
+ * Host test of ulz4fn() (lz4.c) against the corpus in lz4/, made by
+ * lz4/mkcorpus.sh with the lz4 tool. Every file must uncompress to its
+ * .raw, a short output buffer and a cut frame must fail, and corrupted
+ * input must never write out of bounds (build with -fsanitize=address).
+ *
+ *   ./run.sh
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
+
+static const char *names[] = { "empty", "zeros", "random", "text" };
+static const char *modes[] = { "", ".legacy", ".linked", ".checksum",
+	".nocrc" };
+
+static int failed;
+
+#define CHECK(cond, file, what) do { \
+	if (!(cond)) { \
+		printf("FAIL %s: %s\n", file, what); \
+		failed++; \
+	} \
+} while (0)
+
+static unsigned char *load(const char *dir, const char *file, size_t *len)
+{
+	char path[256];
+	unsigned char *buf;
+	FILE *fp;
+	long n;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	fp = fopen(path, "rb");
+	if (!fp) {
+		printf("FAIL %s: cannot open\n", path);
+		exit(1);
+	}
+	fseek(fp, 0, SEEK_END);
+	n = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	/* an exact size heap buffer, so ASan sees reads past the end */
+	buf = malloc(n ? n : 1);
+	if (fread(buf, 1, n, fp) != (size_t)n)
+		exit(1);
+	fclose(fp);
+	*len = n;
+	return buf;
+}
+
+static void test_file(const char *dir, const char *name, const char *mode)
+{
+	char file[64];
+	unsigned char *raw, *src, *dst, *copy;
+	size_t rawlen, srclen, dstn, cut;
+	int legacy = !strcmp(mode, ".legacy");
+	int ix, ret;
+
+	snprintf(file, sizeof(file), "%s.raw", name);
+	raw = load(dir, file, &rawlen);
+	snprintf(file, sizeof(file), "%s%s.lz4", name, mode);
+	src = load(dir, file, &srclen);
+	dst = malloc(rawlen + 1);
+
+	/* the whole file, exact room */
+	dstn = rawlen;
+	ret = ulz4fn(src, srclen, dst, &dstn);
+	CHECK(!ret && dstn == rawlen && !memcmp(dst, raw, rawlen), file,
+		"uncompress");
+
+	/* one byte short of room */
+	if (rawlen) {
+		dstn = rawlen - 1;
+		CHECK(ulz4fn(src, srclen, dst, &dstn), file, "short output");
+	}
+
+	/*
+	 * cut anywhere: a frame cut before its end mark must fail (the
+	 * content checksum after the mark is not checked), legacy just ends
+	 */
+	for (cut = 0; cut < srclen; cut += 1 + cut / 8) {
+		dstn = rawlen;
+		ret = ulz4fn(src, cut, dst, &dstn);
+		if (!legacy && cut + 8 <= srclen)
+			CHECK(ret, file, "cut frame accepted");
+		else
+			CHECK(ret || dstn <= rawlen, file, "cut legacy");
+	}
+
+	/* corrupted bytes, only looking for out of bounds access */
+	copy = malloc(srclen ? srclen : 1);
+	srand(srclen);
+	for (ix = 0; ix < 2000 && srclen; ix++) {
+		memcpy(copy, src, srclen);
+		copy[rand() % srclen] ^= 1 << (rand() % 8);
+		copy[rand() % srclen] = rand();
+		dstn = rawlen;
+		ulz4fn(copy, srclen, dst, &dstn);
+	}
+
+	free(copy);
+	free(dst);
+	free(src);
+	free(raw);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = (argc > 1) ? argv[1] : "lz4";
+	unsigned int n, m;
+
+	for (n = 0; n < sizeof(names) / sizeof(names[0]); n++)
+		for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+			test_file(dir, names[n], modes[m]);
+
+	printf("lz4: %s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}
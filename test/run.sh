@@ -0,0 +1,13 @@
+#!/bin/sh
+# Build and run the host tests of the pure functions, from this directory.
+set -e
+CC=${CC:-cc}
+CFLAGS="-O1 -g -Wall -fsanitize=address,undefined -fno-sanitize-recover -Iinclude"
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+$CC $CFLAGS -o $OUT/lz4_test lz4_test.c ../lz4.c
+$OUT/lz4_test lz4
+
+$CC $CFLAGS -o $OUT/crc16_test crc16_test.c ../crc16_ccitt.c
+$OUT/crc16_test